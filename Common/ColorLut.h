@@ -0,0 +1,43 @@
+#ifndef COLOR_LUT_H
+#define COLOR_LUT_H
+
+#include <cstdint>
+#include <cmath>
+
+#define LUT_SIZE_8		256
+#define LUT_SIZE_12		4096
+
+
+// Colormap LUT (QRgb: 0xAARRGGBB) at 8-bit & 12-bit index resolution, 16-byte aligned
+// The 12-bit table is interpolated linearly between the 256 colors, so that float data
+// can be looked up directly at 12-bit precision (no quantization to 8 bits before the lookup).
+struct ColorLut
+{
+	alignas(16) uint32_t lut8[LUT_SIZE_8];
+	alignas(16) uint32_t lut12[LUT_SIZE_12];
+
+	void build(const uint32_t* table)
+	{
+		for (int i = 0; i < LUT_SIZE_8; i++)
+			lut8[i] = table[i];
+
+		for (int i = 0; i < LUT_SIZE_12; i++)
+		{
+			float x = (float)i * (float)(LUT_SIZE_8 - 1) / (float)(LUT_SIZE_12 - 1);
+			int i0 = (int)x, i1 = (i0 < LUT_SIZE_8 - 1) ? i0 + 1 : i0;
+			float f = x - (float)i0;
+
+			uint32_t color = 0xff000000;
+			for (int s = 0; s < 24; s += 8)
+			{
+				float c0 = (float)((table[i0] >> s) & 0xff), c1 = (float)((table[i1] >> s) & 0xff);
+				color |= (uint32_t)lroundf(c0 + (c1 - c0) * f) << s;
+			}
+			lut12[i] = color;
+		}
+	}
+
+	inline const uint32_t* get(int size) const { return (size == LUT_SIZE_12) ? lut12 : lut8; }
+};
+
+#endif // COLOR_LUT_H
@@ -0,0 +1,225 @@
+#ifndef FLAT_FIELD_H
+#define FLAT_FIELD_H
+
+#include <iostream>
+#include <atomic>
+#include <cstdio>
+
+#include <ipps.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include "array.h"
+#include "Histogram.h"
+
+#define FLAT_FIELD_IDLE		0
+#define FLAT_FIELD_DARK		1
+#define FLAT_FIELD_FLAT		2
+
+
+// Per-pixel dark-frame subtraction & flat-field (vignetting) gain correction
+// out = (acc / avg - dark * frames) * gain, fused into the image averaging pass
+// The maps are kept per single frame (acc: sum of the accumulated frames), so they hold at any accumulation.
+// Captures are requested by the UI thread and started by the image formation thread (applyRequest),
+// map files are loaded aside (load) and swapped in by the caller under its image formation lock (swapLoaded).
+class FlatField
+{
+public:
+	FlatField() : width(0), height(0), captureMode(FLAT_FIELD_IDLE), captureFrames(0), capturedFrames(0),
+		requestedMode(FLAT_FIELD_IDLE), requestedFrames(0)
+	{
+	}
+
+	~FlatField()
+	{
+	}
+
+public:
+	void initialize(int _width, int _height, int _channels)
+	{
+		width = _width;
+		height = _height;
+		channels = _channels;
+
+		dark = np::FloatArray2(width * height, channels);
+		gain = np::FloatArray2(width * height, channels);
+		sum = np::FloatArray2(width * height, channels);
+
+		reset();
+	}
+
+	void reset()
+	{
+		ippsSet_32f(0.0f, dark.raw_ptr(), dark.length());
+		ippsSet_32f(1.0f, gain.raw_ptr(), gain.length());
+	}
+
+	// Fused correction of one channel plane (& histogram of the corrected image)
+	void operator() (const float* acc, float inv_avg, float frames, float* dst, int ch, Histogram* hist = nullptr)
+	{
+		const float* pDark = &dark(0, ch);
+		const float* pGain = &gain(0, ch);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)height),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			{
+				int offset = (int)i * width;
+				for (int j = offset; j < offset + width; j++)
+					dst[j] = (acc[j] * inv_avg - pDark[j] * frames) * pGain[j];
+				if (hist)
+					hist->add(dst + offset, width, (int)i);
+			}
+		});
+	}
+
+	// Map capture (averaged over N formed frames), requested by the UI thread
+	void startCapture(int mode, int frames)
+	{
+		requestedFrames = (frames > 0) ? frames : 1;
+		requestedMode = mode;
+	}
+
+	// Image formation thread: starts the requested capture (before the frame is formed)
+	void applyRequest()
+	{
+		int mode = requestedMode.exchange(FLAT_FIELD_IDLE);
+		if (mode == FLAT_FIELD_IDLE)
+			return;
+
+		captureFrames = requestedFrames;
+		capturedFrames = 0;
+		ippsSet_32f(0.0f, sum.raw_ptr(), sum.length());
+		captureMode = mode;
+	}
+
+	bool isCapturing() const { return captureMode != FLAT_FIELD_IDLE; }
+	int getCaptureMode() const { return captureMode; }
+
+	// Formed image of accumulated frames (normalized to a single frame)
+	void accumulate(const float* image, int ch, float frames)
+	{
+		ippsAddProductC_32f(image, 1.0f / frames, &sum(0, ch), width * height);
+	}
+
+	// Returns the finished capture mode (FLAT_FIELD_IDLE if still capturing)
+	int finishFrame()
+	{
+		if (++capturedFrames < captureFrames)
+			return FLAT_FIELD_IDLE;
+
+		int mode = captureMode;
+		ippsDivC_32f_I((Ipp32f)captureFrames, sum.raw_ptr(), sum.length());
+
+		if (mode == FLAT_FIELD_DARK)
+		{
+			memcpy(dark.raw_ptr(), sum.raw_ptr(), sizeof(float) * dark.length());
+			if (flat.length() == dark.length()) // re-reference the existing flat map
+			{
+				memcpy(sum.raw_ptr(), flat.raw_ptr(), sizeof(float) * sum.length());
+				setGain(dark, sum, gain, flat);
+			}
+		}
+		else if (mode == FLAT_FIELD_FLAT)
+			setGain(dark, sum, gain, flat);
+
+		captureMode = FLAT_FIELD_IDLE;
+		return mode;
+	}
+
+	// Map files (raw float32, channel planes), loaded aside of the maps in use
+	bool load(const char* dark_path, const char* flat_path)
+	{
+		loaded_dark = np::FloatArray2(width * height, channels);
+		loaded_gain = np::FloatArray2(width * height, channels);
+		loaded_flat = np::FloatArray2();
+		ippsSet_32f(1.0f, loaded_gain.raw_ptr(), loaded_gain.length());
+
+		bool dark_ok = read(dark_path, loaded_dark);
+		if (!dark_ok) ippsSet_32f(0.0f, loaded_dark.raw_ptr(), loaded_dark.length());
+
+		np::FloatArray2 raw(width * height, channels);
+		bool flat_ok = read(flat_path, raw);
+		if (flat_ok) setGain(loaded_dark, raw, loaded_gain, loaded_flat);
+
+		return dark_ok || flat_ok;
+	}
+
+	// Loaded maps into use (no copy)
+	void swapLoaded()
+	{
+		dark = loaded_dark;
+		gain = loaded_gain;
+		flat = loaded_flat;
+	}
+
+	bool save(const char* dark_path, const char* flat_path)
+	{
+		bool ok = write(dark_path, dark);
+		if (flat.length() == dark.length())
+			ok = ok && write(flat_path, flat);
+
+		return ok;
+	}
+
+private:
+	void setGain(const np::FloatArray2& _dark, const np::FloatArray2& raw, np::FloatArray2& _gain, np::FloatArray2& _flat)
+	{
+		// gain = mean / (flat - dark); the raw flat map is kept to be saved
+		_flat = np::FloatArray2(width * height, channels);
+		ippsSub_32f(_dark.raw_ptr(), raw.raw_ptr(), _flat.raw_ptr(), _flat.length());
+
+		for (int c = 0; c < channels; c++)
+		{
+			Ipp32f mean;
+			ippsMean_32f(&_flat(0, c), width * height, &mean, ippAlgHintFast);
+
+			for (int i = 0; i < width * height; i++)
+				_gain(i, c) = ((mean > 0) && (_flat(i, c) > 0.05f * mean)) ? mean / _flat(i, c) : 1.0f;
+		}
+		ippsAdd_32f(_dark.raw_ptr(), _flat.raw_ptr(), _flat.raw_ptr(), _flat.length());
+	}
+
+	bool read(const char* path, np::FloatArray2& arr)
+	{
+		FILE* fp = fopen(path, "rb");
+		if (!fp) return false;
+
+		size_t n = fread(arr.raw_ptr(), sizeof(float), arr.length(), fp);
+		fclose(fp);
+
+		return n == (size_t)arr.length();
+	}
+
+	bool write(const char* path, const np::FloatArray2& arr)
+	{
+		if (arr.length() != width * height * channels) return false;
+
+		FILE* fp = fopen(path, "wb");
+		if (!fp) return false;
+
+		size_t n = fwrite(arr.raw_ptr(), sizeof(float), arr.length(), fp);
+		fclose(fp);
+
+		return n == (size_t)arr.length();
+	}
+
+private:
+	int width, height, channels;
+	int captureMode;
+	int captureFrames, capturedFrames;
+	std::atomic<int> requestedMode;
+	std::atomic<int> requestedFrames;
+
+public:
+	np::FloatArray2 dark;
+	np::FloatArray2 gain;
+	np::FloatArray2 flat;
+
+private:
+	np::FloatArray2 sum;
+	np::FloatArray2 loaded_dark, loaded_gain, loaded_flat;
+};
+
+#endif
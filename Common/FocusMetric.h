@@ -0,0 +1,229 @@
+#ifndef FOCUS_METRIC_H
+#define FOCUS_METRIC_H
+
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <emmintrin.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#define FOCUS_LAPLACIAN		0 // variance of the 4-neighbour Laplacian
+#define FOCUS_GRADIENT		1 // gradient energy normalized by the squared mean
+
+
+// Sharpness of a float image (first rows only, galvo flyback rows excluded)
+// Row-wise SSE passes over the interior pixels, row sums reduced in double in row order (deterministic).
+class FocusMetric
+{
+public:
+	FocusMetric() : mode(FOCUS_LAPLACIAN)
+	{
+	}
+
+	~FocusMetric()
+	{
+	}
+
+public:
+	void setMode(int _mode) { mode = _mode; }
+	int getMode() const { return mode; }
+
+	float operator() (const float* image, int width, int height)
+	{
+		if ((width < 3) || (height < 3))
+			return 0.0f;
+
+		partial.resize(3 * height);
+		tbb::parallel_for(tbb::blocked_range<size_t>(1, (size_t)(height - 1)),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			{
+				const float* up = image + ((int)i - 1) * width;
+				const float* row = image + (int)i * width;
+				const float* down = image + ((int)i + 1) * width;
+
+				__m128 vsum = _mm_setzero_ps(), vsq = _mm_setzero_ps(), vsrc = _mm_setzero_ps();
+				const __m128 four = _mm_set1_ps(4.0f);
+				int j = 1;
+				for (; j + 4 <= width - 1; j += 4)
+				{
+					__m128 c = _mm_loadu_ps(row + j);
+					__m128 v;
+					if (mode == FOCUS_LAPLACIAN)
+					{
+						__m128 n = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row + j - 1), _mm_loadu_ps(row + j + 1)),
+							_mm_add_ps(_mm_loadu_ps(up + j), _mm_loadu_ps(down + j)));
+						v = _mm_sub_ps(_mm_mul_ps(four, c), n);
+						vsum = _mm_add_ps(vsum, v);
+					}
+					else
+					{
+						__m128 gx = _mm_sub_ps(_mm_loadu_ps(row + j + 1), c);
+						__m128 gy = _mm_sub_ps(_mm_loadu_ps(down + j), c);
+						v = _mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy));
+						vsrc = _mm_add_ps(vsrc, c);
+					}
+					vsq = _mm_add_ps(vsq, (mode == FOCUS_LAPLACIAN) ? _mm_mul_ps(v, v) : v);
+				}
+
+				float a[4], b[4], s[4];
+				_mm_storeu_ps(a, vsum); _mm_storeu_ps(b, vsq); _mm_storeu_ps(s, vsrc);
+				float row_sum = (a[0] + a[1]) + (a[2] + a[3]);
+				float row_sq = (b[0] + b[1]) + (b[2] + b[3]);
+				float row_src = (s[0] + s[1]) + (s[2] + s[3]);
+				for (; j < width - 1; j++)
+				{
+					float c = row[j];
+					if (mode == FOCUS_LAPLACIAN)
+					{
+						float v = 4.0f * c - ((row[j - 1] + row[j + 1]) + (up[j] + down[j]));
+						row_sum += v; row_sq += v * v;
+					}
+					else
+					{
+						float gx = row[j + 1] - c, gy = down[j] - c;
+						row_sq += gx * gx + gy * gy;
+						row_src += c;
+					}
+				}
+
+				partial[3 * i] = row_sum;
+				partial[3 * i + 1] = row_sq;
+				partial[3 * i + 2] = row_src;
+			}
+		});
+
+		double sum = 0.0, sumsq = 0.0, src = 0.0;
+		for (int i = 1; i < height - 1; i++)
+		{
+			sum += partial[3 * i];
+			sumsq += partial[3 * i + 1];
+			src += partial[3 * i + 2];
+		}
+
+		double n = (double)(width - 2) * (double)(height - 2);
+		if (mode == FOCUS_LAPLACIAN)
+		{
+			double mean = sum / n;
+			return (float)std::max(sumsq / n - mean * mean, 0.0);
+		}
+		else
+		{
+			double mean = src / n;
+			return (mean != 0.0) ? (float)(sumsq / n / (mean * mean)) : 0.0f;
+		}
+	}
+
+private:
+	int mode;
+	std::vector<double> partial; // per row: sum, sum of squares, sum of source
+};
+
+
+// Focus search over a continuous stage sweep (the sweep overlaps with the image acquisition)
+// Each averaged image is added with its formation time, and placed at the position the stage had at the mean time
+// of its integration (constant sweep speed from the start of the sweep): lag in formation intervals before the
+// formation, 0.5 for block averages, the mean age of the frames for running averages. The optimum is refined by a parabola
+// through the best sample and its neighbours.
+class FocusSweep
+{
+public:
+	FocusSweep() : running(false), speed(0), range(0), last(-1)
+	{
+	}
+
+	~FocusSweep()
+	{
+	}
+
+public:
+	// Sweep of range (mm) at speed (mm/s) starting now
+	void begin(double _speed, double _range)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		speed = _speed;
+		range = _range;
+		positions.clear();
+		metrics.clear();
+		start = std::chrono::steady_clock::now();
+		last = -1;
+		running = true;
+	}
+
+	void end()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		running = false;
+	}
+
+	bool isRunning() const { return running; }
+
+	void add(float metric, double lag = 0.5)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		if (!running)
+			return;
+
+		double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double mean = (last >= 0) ? t - lag * (t - last) : t; // mean time of the integration of this image
+		last = t;
+
+		double pos = speed * mean;
+		if ((pos < 0) || (pos > range))
+			return;
+
+		positions.push_back(pos);
+		metrics.push_back(metric);
+	}
+
+	int getCount()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		return (int)metrics.size();
+	}
+
+	// Best position (mm from the sweep start), false if too few samples
+	bool best(double& pos)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		int n = (int)metrics.size();
+		if (n < 3)
+			return false;
+
+		int k = (int)(std::max_element(metrics.begin(), metrics.end()) - metrics.begin());
+		pos = positions[k];
+		if ((k > 0) && (k < n - 1))
+		{
+			// Vertex of the parabola through (k - 1, k, k + 1)
+			double x0 = positions[k - 1], x1 = positions[k], x2 = positions[k + 1];
+			double y0 = metrics[k - 1], y1 = metrics[k], y2 = metrics[k + 1];
+			double d = (x0 - x1) * (x0 - x2) * (x1 - x2);
+			double a = (x2 * (y1 - y0) + x1 * (y0 - y2) + x0 * (y2 - y1)) / d;
+			double b = (x2 * x2 * (y0 - y1) + x1 * x1 * (y2 - y0) + x0 * x0 * (y1 - y2)) / d;
+			if ((d != 0) && (a < 0))
+				pos = std::min(std::max(-b / (2 * a), x0), x2);
+		}
+
+		return true;
+	}
+
+private:
+	std::mutex mtx;
+	std::atomic<bool> running;
+	double speed, range;
+	std::chrono::steady_clock::time_point start;
+	double last;
+
+	std::vector<double> positions;
+	std::vector<float> metrics;
+};
+
+#endif // FOCUS_METRIC_H
@@ -0,0 +1,267 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+
+#include "array.h"
+
+#define HISTOGRAM_BINS		1024
+
+
+// Pixels outside the contrast range (clipped to black or white) & at or above the saturation level
+struct HistogramClipping
+{
+	float under, over, saturated; // fractions
+	int n;
+};
+
+// Streaming per-channel histogram of the formed float images
+// Filled inside the averaging pass (add() per row, from any TBB thread) between begin() and end().
+// The bin range of each frame follows the min/max observed in the previous one. (up to 4 channels)
+// While a viewer is open, the bins & clipping counts of each frame are copied out for it (once per frame).
+class Histogram
+{
+public:
+	Histogram() : channels(0), rows(INT_MAX), enabled(false)
+	{
+	}
+
+	~Histogram()
+	{
+	}
+
+public:
+	void initialize(int _channels, int _rows = INT_MAX)
+	{
+		channels = _channels;
+		rows = _rows;
+		bins = np::Array<int, 2>(HISTOGRAM_BINS, channels);
+		memset(bins.raw_ptr(), 0, sizeof(int) * bins.length());
+
+		lo.assign(channels, 0.0f); hi.assign(channels, 1.0f);
+		frame_lo.assign(channels, 0.0f); frame_hi.assign(channels, 1.0f);
+		min.assign(channels, 0.0f); max.assign(channels, 1.0f);
+		for (int c = 0; c < 4; c++) { range_min[c] = 0.0f; range_max[c] = 0.0f; }
+		smoothed.assign(channels, false);
+		ranged.assign(channels, false); valid.assign(channels, false);
+
+		std::unique_lock<std::mutex> lock(mtx);
+		view_bins = np::Array<int, 2>(HISTOGRAM_BINS, channels);
+		memset(view_bins.raw_ptr(), 0, sizeof(int) * view_bins.length());
+		view_lo.assign(channels, 0.0f); view_hi.assign(channels, 1.0f);
+		view_clipping.assign(channels, HistogramClipping{ 0.0f, 0.0f, 0.0f, 0 });
+		sequence.assign(channels, 0); fetched.assign(channels, 0);
+	}
+
+	// Only copied out while a viewer is open
+	void setEnabled(bool _enabled) { enabled = _enabled; }
+	bool isEnabled() const { return enabled; }
+
+	// Contrast range & saturation level of the channel (counted along with the bins)
+	void begin(int ch, float clip_min = -FLT_MAX, float clip_max = FLT_MAX, float saturation = FLT_MAX)
+	{
+		cur_lo = lo[ch];
+		cur_scale = (hi[ch] > lo[ch]) ? (float)HISTOGRAM_BINS / (hi[ch] - lo[ch]) : 0.0f;
+		cur_clip_min = clip_min; cur_clip_max = clip_max; cur_saturation = saturation;
+	}
+
+	void add(const float* data, int n, int row)
+	{
+		if (row >= rows) // rows excluded (galvo flyback)
+			return;
+
+		Local& local = locals.local();
+		if (local.bins.size() != HISTOGRAM_BINS)
+			local.reset();
+
+		int counted = 0;
+		for (int i = 0; i < n; i++)
+		{
+			float v = data[i];
+			if (!std::isfinite(v)) // NaN & Inf (e.g. flat-field gain, unmixing) not counted
+				continue;
+			if (v < local.min) local.min = v;
+			if (v > local.max) local.max = v;
+
+			// Clamped in float before the conversion (out-of-range values)
+			float x = (v - cur_lo) * cur_scale;
+			x = (x > 0.0f) ? ((x < (float)(HISTOGRAM_BINS - 1)) ? x : (float)(HISTOGRAM_BINS - 1)) : 0.0f;
+			local.bins[(int)x]++;
+
+			local.under += (v < cur_clip_min);
+			local.over += (v > cur_clip_max);
+			local.saturated += (v >= cur_saturation);
+			counted++;
+		}
+		local.n += counted;
+	}
+
+	void end(int ch)
+	{
+		int* pBins = &bins(0, ch);
+		memset(pBins, 0, sizeof(int) * HISTOGRAM_BINS);
+
+		float _min = FLT_MAX, _max = -FLT_MAX;
+		int under = 0, over = 0, saturated = 0, n = 0;
+		for (Local& local : locals)
+		{
+			if (local.bins.size() != HISTOGRAM_BINS) continue;
+			for (int i = 0; i < HISTOGRAM_BINS; i++)
+				pBins[i] += local.bins[i];
+			if (local.min < _min) _min = local.min;
+			if (local.max > _max) _max = local.max;
+			under += local.under; over += local.over; saturated += local.saturated; n += local.n;
+			local.reset();
+		}
+		if (_min > _max)
+			return;
+
+		// Copy for the viewer (bins of a valid range only)
+		if (enabled && ranged[ch])
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			memcpy(&view_bins(0, ch), pBins, sizeof(int) * HISTOGRAM_BINS);
+			view_lo[ch] = lo[ch]; view_hi[ch] = hi[ch];
+			float inv = (n > 0) ? 1.0f / (float)n : 0.0f;
+			view_clipping[ch] = { under * inv, over * inv, saturated * inv, n };
+			sequence[ch]++;
+		}
+
+		// Bin range of this frame & the next one (the first frame only sets the range)
+		valid[ch] = ranged[ch];
+		ranged[ch] = true;
+		frame_lo[ch] = lo[ch]; frame_hi[ch] = hi[ch];
+		min[ch] = _min; max[ch] = _max;
+		lo[ch] = _min; hi[ch] = (_max > _min) ? _max : _min + 1.0f;
+	}
+
+	// Fused averaging (dst = src * scale) & histogram
+	void scale(const float* src, float scale, float* dst, int width, int height)
+	{
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)height),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			{
+				int offset = (int)i * width;
+				for (int j = offset; j < offset + width; j++)
+					dst[j] = src[j] * scale;
+				add(dst + offset, width, (int)i);
+			}
+		});
+	}
+
+	// Value at the given percentile (0-100) of the last frame (linear within a bin)
+	float percentile(int ch, float p) const
+	{
+		const int* pBins = &bins(0, ch);
+		int total = 0;
+		for (int i = 0; i < HISTOGRAM_BINS; i++)
+			total += pBins[i];
+		if (total == 0)
+			return 0.0f;
+
+		float target = p / 100.0f * (float)total;
+		float width = (frame_hi[ch] - frame_lo[ch]) / (float)HISTOGRAM_BINS;
+		int cum = 0;
+		for (int i = 0; i < HISTOGRAM_BINS; i++)
+		{
+			if (cum + pBins[i] >= target)
+			{
+				float frac = (pBins[i] > 0) ? (target - cum) / (float)pBins[i] : 0.0f;
+				return frame_lo[ch] + ((float)i + frac) * width;
+			}
+			cum += pBins[i];
+		}
+		return frame_hi[ch];
+	}
+
+	// Auto-contrast range: percentiles with exponential smoothing over frames
+	void updateRange(int ch, float p_lo, float p_hi, float alpha)
+	{
+		if (!valid[ch])
+			return;
+
+		float _min = percentile(ch, p_lo);
+		float _max = percentile(ch, p_hi);
+
+		if (!smoothed[ch])
+		{
+			range_min[ch] = _min; range_max[ch] = _max;
+			smoothed[ch] = true;
+		}
+		else
+		{
+			range_min[ch] = range_min[ch] + alpha * (_min - range_min[ch]);
+			range_max[ch] = range_max[ch] + alpha * (_max - range_max[ch]);
+		}
+	}
+
+	void resetRange()
+	{
+		smoothed.assign(channels, false);
+	}
+
+	// Viewer: bins (HISTOGRAM_BINS) & bin range & clipping of the last frame, false if nothing new
+	bool fetch(int ch, int* dst, float& _lo, float& _hi, HistogramClipping& clipping)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		if ((ch >= channels) || (sequence[ch] == 0) || (sequence[ch] == fetched[ch]))
+			return false;
+		fetched[ch] = sequence[ch];
+
+		memcpy(dst, &view_bins(0, ch), sizeof(int) * HISTOGRAM_BINS);
+		_lo = view_lo[ch]; _hi = view_hi[ch];
+		clipping = view_clipping[ch];
+
+		return true;
+	}
+
+private:
+	struct Local
+	{
+		std::vector<int> bins;
+		float min, max;
+		int under, over, saturated, n;
+
+		void reset()
+		{
+			bins.assign(HISTOGRAM_BINS, 0);
+			min = FLT_MAX; max = -FLT_MAX;
+			under = 0; over = 0; saturated = 0; n = 0;
+		}
+	};
+
+	int channels, rows;
+	float cur_lo, cur_scale;
+	float cur_clip_min, cur_clip_max, cur_saturation;
+	std::vector<float> lo, hi; // bin range of the next frame
+	std::vector<float> frame_lo, frame_hi; // bin range of the last frame
+	std::vector<bool> smoothed, ranged;
+	tbb::enumerable_thread_specific<Local> locals;
+
+	std::mutex mtx;
+	std::atomic<bool> enabled;
+	np::Array<int, 2> view_bins;
+	std::vector<float> view_lo, view_hi;
+	std::vector<HistogramClipping> view_clipping;
+	std::vector<uint64_t> sequence, fetched;
+
+public:
+	np::Array<int, 2> bins; // (HISTOGRAM_BINS, channels)
+	std::vector<bool> valid; // bins of the last frame are meaningful
+	std::vector<float> min, max; // observed in the last frame
+	std::atomic<float> range_min[4], range_max[4]; // auto-contrast range (read by the UI thread)
+};
+
+#endif // HISTOGRAM_H
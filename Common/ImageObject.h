@@ -45,42 +45,41 @@ public:
 
 	void convertRgb()
 	{
-		qrgbimg = QImage(width, height, QImage::Format_RGB888);
-		np::Uint8Array2 rgbarr(qrgbimg.bits(), 3 * width, height);
+		// Into the pre-allocated qrgbimg (no reallocation)
+		const QRgb* ctable = colortable.constData();
+		const uchar* src = qindeximg.constBits();
+		int src_step = qindeximg.bytesPerLine();
+		uchar* dst = qrgbimg.bits();
+		int dst_step = qrgbimg.bytesPerLine();
 
 		tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)height),
 			[&](const tbb::blocked_range<size_t>& r) {
 			for (size_t i = r.begin(); i != r.end(); ++i)
 			{
+				const uchar* pSrc = src + (int)i * src_step;
+				uchar* pDst = dst + (int)i * dst_step;
 				for (int j = 0; j < width; j++)
 				{
-					QRgb val = colortable.at(arr(j, (int)i));
-					rgbarr(3 * j + 0, (int)i) = qRed(val);
-					rgbarr(3 * j + 1, (int)i) = qGreen(val);
-					rgbarr(3 * j + 2, (int)i) = qBlue(val);
+					QRgb val = ctable[pSrc[j]];
+					pDst[3 * j + 0] = qRed(val);
+					pDst[3 * j + 1] = qGreen(val);
+					pDst[3 * j + 2] = qBlue(val);
 				}
 			}
 		});
 	}
 
-	void convertScaledRgb()
+	// Top rows of the indexed image sharing its buffer (no deep copy)
+	QImage topRows(int rows)
 	{
-		qrgbimg = std::move(qindeximg.scaled(4 * width, height).convertToFormat(QImage::Format_RGB888));
+		QImage img(qindeximg.bits(), width, rows, qindeximg.bytesPerLine(), QImage::Format_Indexed8);
+		img.setColorTable(colortable);
+		return img;
 	}
 
 	void convertNonScaledRgb()
 	{
-		qrgbimg = std::move(qindeximg.convertToFormat(QImage::Format_RGB888));
-	}
-
-	void scaled4()
-	{
-		qindeximg = std::move(qindeximg.scaled(4 * width, height));
-	}
-
-	void scaledRgb4()
-	{
-		qrgbimg = std::move(qrgbimg.scaled(4 * width, height));
+		convertRgb();
 	}
 
 	void setRgbChannelData(uchar* data, int ch)
@@ -0,0 +1,229 @@
+#ifndef IMAGE_RENDER_H
+#define IMAGE_RENDER_H
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <emmintrin.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+
+#include <Common/ColorLut.h>
+
+// Overlay colors (QRgb) of the clipped & saturated pixels
+#define OVERLAY_UNDER		0xff0040ff // below the contrast range (blue)
+#define OVERLAY_OVER		0xffff2000 // above the contrast range (red)
+#define OVERLAY_SATURATED	0xffff00ff // at or above the saturation level (magenta)
+
+
+// Single channel to be rendered
+struct RenderChannel
+{
+	const float* src; // float image (width x height, row-major)
+	float min, max; // contrast range
+	const uint32_t* lut; // color table (QRgb: 0xAARRGGBB) of lut_size entries
+	int lut_size; // LUT_SIZE_8 or LUT_SIZE_12 (float data looked up at 12-bit precision)
+
+	// Intensity-weighted lifetime mode (nullptr: off): lifetime -> hue (lut over [lt_min, lt_max]), intensity -> brightness
+	const float* lifetime; // same layout as src
+	float lt_min, lt_max;
+
+	// Overlay (false: off): clipped & saturated pixels replaced by the overlay colors
+	bool overlay;
+	float saturation; // saturation level (FLT_MAX: not monitored)
+};
+
+// Fused contrast scaling + LUT lookup + additive (saturating) blending of n channels
+// into a 32-bit display buffer (QImage::Format_RGB32), in a single pass over the image.
+// The scaling is the same as ippiScale_32f8u: [min, max] -> [0, lut_size - 1] with saturation (straight to the LUT index).
+// Region rendering: src points at the region origin with a row pitch of stride samples,
+// and factor x factor blocks are box-filtered into each output pixel (width x height output).
+// Lifetime channels: the hue color of the scaled lifetime is multiplied by the intensity scaled to [0, 255] (/255, rounded).
+// Overlay channels: the clipping & saturation masks come from the same comparisons (saturated > over > under
+// over all overlay channels of the pixel), and are composited over the blended color in the same pass.
+inline void renderImage(uint32_t* dst, int width, int height, const RenderChannel* channels, int n, int stride = 0, int factor = 1)
+{
+	if (stride == 0)
+		stride = width * factor;
+
+	float scale[8], offset[8], lt_scale[8], lt_offset[8], sat[8], full[8], weight[8];
+	bool overlay = false;
+	for (int c = 0; c < n; c++)
+	{
+		sat[c] = channels[c].saturation;
+		overlay |= channels[c].overlay;
+
+		full[c] = (float)(((channels[c].lut_size == LUT_SIZE_12) ? LUT_SIZE_12 : LUT_SIZE_8) - 1);
+		weight[c] = 255.0f / full[c];
+
+		float range = channels[c].max - channels[c].min;
+		scale[c] = (range != 0) ? full[c] / range : 0.0f;
+		offset[c] = channels[c].min;
+
+		range = channels[c].lt_max - channels[c].lt_min;
+		lt_scale[c] = (channels[c].lifetime && (range != 0)) ? full[c] / range : 0.0f;
+		lt_offset[c] = channels[c].lifetime ? channels[c].lt_min : 0.0f;
+	}
+
+	// Decimated rows (per worker thread, intensity & lifetime of each channel), kept across frames
+	static tbb::enumerable_thread_specific<std::vector<float>> scratch;
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)height),
+		[&](const tbb::blocked_range<size_t>& r) {
+		std::vector<float>& rows = scratch.local();
+		size_t rows_size = (factor > 1) ? (size_t)(2 * n * width + width * factor) : 0;
+		if (rows.size() < rows_size)
+			rows.resize(rows_size); // grows only
+		float norm = 1.0f / (float)(factor * factor);
+
+		// Box filter: vertical sum of factor rows, then horizontal sum of factor samples
+		auto decimate = [&](const float* src, float* out) {
+			float* acc = &rows[2 * n * width];
+			memcpy(acc, src, sizeof(float) * width * factor);
+			for (int k = 1; k < factor; k++)
+			{
+				const float* src_k = src + k * stride;
+				for (int j = 0; j < width * factor; j++)
+					acc[j] += src_k[j];
+			}
+
+			for (int j = 0; j < width; j++)
+			{
+				float sum = 0.0f;
+				for (int k = 0; k < factor; k++)
+					sum += acc[j * factor + k];
+				out[j] = sum * norm;
+			}
+			return (const float*)out;
+		};
+
+		for (size_t i = r.begin(); i != r.end(); ++i)
+		{
+			uint32_t* pDst = dst + (int)i * width;
+
+			const float* pSrc[8];
+			const float* pLifetime[8];
+			for (int c = 0; c < n; c++)
+			{
+				int offset_i = (int)i * factor * stride;
+				pSrc[c] = (factor == 1) ? channels[c].src + offset_i : decimate(channels[c].src + offset_i, &rows[c * width]);
+				pLifetime[c] = nullptr;
+				if (channels[c].lifetime)
+					pLifetime[c] = (factor == 1) ? channels[c].lifetime + offset_i : decimate(channels[c].lifetime + offset_i, &rows[(n + c) * width]);
+			}
+
+			const __m128 zero = _mm_setzero_ps();
+			const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+			const __m128i zero_i = _mm_setzero_si128();
+			const __m128i round = _mm_set1_epi16(128);
+			const __m128i under_color = _mm_set1_epi32((int)OVERLAY_UNDER);
+			const __m128i over_color = _mm_set1_epi32((int)OVERLAY_OVER);
+			const __m128i sat_color = _mm_set1_epi32((int)OVERLAY_SATURATED);
+
+			int j = 0;
+			for (; j + 4 <= width; j += 4)
+			{
+				__m128i acc = _mm_setzero_si128();
+				__m128 under = zero, over = zero, saturated = zero;
+				for (int c = 0; c < n; c++)
+				{
+					// Scaling (NaN is mapped to 0 by max)
+					__m128 v0 = _mm_loadu_ps(pSrc[c] + j);
+					__m128 v = _mm_mul_ps(_mm_sub_ps(v0, _mm_set1_ps(offset[c])), _mm_set1_ps(scale[c]));
+					const __m128 full_c = _mm_set1_ps(full[c]);
+					if (channels[c].overlay)
+					{
+						under = _mm_or_ps(under, _mm_cmplt_ps(v, zero));
+						over = _mm_or_ps(over, _mm_cmpgt_ps(v, full_c));
+						saturated = _mm_or_ps(saturated, _mm_cmpge_ps(v0, _mm_set1_ps(sat[c])));
+					}
+					v = _mm_min_ps(_mm_max_ps(v, zero), full_c);
+
+					// LUT lookup
+					int idx[4];
+					_mm_storeu_si128((__m128i*)idx, _mm_cvtps_epi32(v));
+					const uint32_t* lut = channels[c].lut;
+					__m128i color;
+					if (!pLifetime[c])
+						color = _mm_set_epi32((int)lut[idx[3]], (int)lut[idx[2]], (int)lut[idx[1]], (int)lut[idx[0]]);
+					else
+					{
+						// Hue of the lifetime, brightness of the intensity: (color * v + 128) / 255 per byte
+						__m128 t = _mm_loadu_ps(pLifetime[c] + j);
+						t = _mm_mul_ps(_mm_sub_ps(t, _mm_set1_ps(lt_offset[c])), _mm_set1_ps(lt_scale[c]));
+						t = _mm_min_ps(_mm_max_ps(t, zero), full_c);
+
+						int hue[4];
+						_mm_storeu_si128((__m128i*)hue, _mm_cvtps_epi32(t));
+						color = _mm_set_epi32((int)lut[hue[3]], (int)lut[hue[2]], (int)lut[hue[1]], (int)lut[hue[0]]);
+
+						__m128i w = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(weight[c])));
+						w = _mm_packs_epi32(w, w);
+						w = _mm_unpacklo_epi16(w, w);
+						__m128i w_lo = _mm_unpacklo_epi32(w, w), w_hi = _mm_unpackhi_epi32(w, w);
+
+						__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(color, zero_i), w_lo), round);
+						__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(color, zero_i), w_hi), round);
+						lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+						hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+						color = _mm_packus_epi16(lo, hi);
+					}
+
+					// Additive blending
+					acc = _mm_adds_epu8(acc, color);
+				}
+				if (overlay)
+				{
+					// Overlay colors where the masks are set (lowest priority first)
+					__m128i m = _mm_castps_si128(under);
+					acc = _mm_or_si128(_mm_and_si128(m, under_color), _mm_andnot_si128(m, acc));
+					m = _mm_castps_si128(over);
+					acc = _mm_or_si128(_mm_and_si128(m, over_color), _mm_andnot_si128(m, acc));
+					m = _mm_castps_si128(saturated);
+					acc = _mm_or_si128(_mm_and_si128(m, sat_color), _mm_andnot_si128(m, acc));
+				}
+				_mm_storeu_si128((__m128i*)(pDst + j), _mm_or_si128(acc, alpha));
+			}
+
+			for (; j < width; j++)
+			{
+				uint32_t r0 = 0, g0 = 0, b0 = 0;
+				uint32_t mask = 0; // 1: under, 2: over, 4: saturated
+				for (int c = 0; c < n; c++)
+				{
+					float v = (pSrc[c][j] - offset[c]) * scale[c];
+					if (channels[c].overlay)
+						mask |= (v < 0.0f) | ((v > full[c]) << 1) | ((pSrc[c][j] >= sat[c]) << 2);
+					v = (v > 0) ? ((v < full[c]) ? v : full[c]) : 0.0f;
+
+					uint32_t idx = (uint32_t)_mm_cvtss_si32(_mm_set_ss(v));
+					if (!pLifetime[c])
+					{
+						uint32_t color = channels[c].lut[idx];
+						r0 += (color >> 16) & 0xff; g0 += (color >> 8) & 0xff; b0 += color & 0xff;
+						continue;
+					}
+
+					float t = (pLifetime[c][j] - lt_offset[c]) * lt_scale[c];
+					t = (t > 0) ? ((t < full[c]) ? t : full[c]) : 0.0f;
+					uint32_t color = channels[c].lut[_mm_cvtss_si32(_mm_set_ss(t))];
+
+					uint32_t w = (uint32_t)_mm_cvtss_si32(_mm_set_ss(v * weight[c])), x;
+					x = ((color >> 16) & 0xff) * w + 128; r0 += (x + (x >> 8)) >> 8;
+					x = ((color >> 8) & 0xff) * w + 128; g0 += (x + (x >> 8)) >> 8;
+					x = (color & 0xff) * w + 128; b0 += (x + (x >> 8)) >> 8;
+				}
+				r0 = (r0 > 255) ? 255 : r0; g0 = (g0 > 255) ? 255 : g0; b0 = (b0 > 255) ? 255 : b0;
+				pDst[j] = 0xff000000 | (r0 << 16) | (g0 << 8) | b0;
+				if (mask)
+					pDst[j] = (mask & 4) ? OVERLAY_SATURATED : ((mask & 2) ? OVERLAY_OVER : OVERLAY_UNDER);
+			}
+		}
+	});
+}
+
+#endif // IMAGE_RENDER_H
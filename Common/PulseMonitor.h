@@ -0,0 +1,144 @@
+#ifndef PULSE_MONITOR_H
+#define PULSE_MONITOR_H
+
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <cfloat>
+
+#include "array.h"
+
+#define PULSE_MONITOR_FRAMES	16
+
+
+// Rolling monitor of the raw pulse at the selected A-line
+// The processing thread pushes the selected pulse once per frame (O(pulse length)), and the A-line pulses
+// of the selected line only when the viewer has taken the previous ones. The viewer fetches the rolling
+// mean & min/max envelope over the last PULSE_MONITOR_FRAMES frames at its own (display) rate.
+class PulseMonitor
+{
+public:
+	PulseMonitor() : length(0), alines(0), frames(0), count(0), head(0), sequence(0), fetched(0),
+		enabled(false), image_wanted(true), line(0), aline(0)
+	{
+	}
+
+	~PulseMonitor()
+	{
+	}
+
+public:
+	void initialize(int _length, int _alines, int _frames = PULSE_MONITOR_FRAMES)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		length = _length;
+		alines = _alines;
+		frames = _frames;
+
+		ring = np::FloatArray2(length, frames);
+		sum = np::FloatArray(length);
+		image = np::Uint16Array2(length, alines);
+		memset(image.raw_ptr(), 0, sizeof(uint16_t) * image.length());
+
+		reset();
+	}
+
+	void reset()
+	{
+		count = 0;
+		head = 0;
+		memset(sum.raw_ptr(), 0, sizeof(float) * sum.length());
+	}
+
+	// Only fed while a viewer is open
+	void setEnabled(bool _enabled) { enabled = _enabled; }
+	bool isEnabled() const { return enabled; }
+
+	// Selected A-line (line & A-line index in the line)
+	void select(int _line, int _aline)
+	{
+		if ((_line != line) || (_aline != aline))
+		{
+			line = _line; aline = _aline;
+			std::unique_lock<std::mutex> lock(mtx);
+			reset();
+		}
+	}
+	int getLine() const { return line; }
+	int getAline() const { return aline; }
+
+	// Producer: selected pulse (length samples) & pulses of the selected line (alines x length samples)
+	void push(const uint16_t* pulse, const uint16_t* line_pulses)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		float* pNew = &ring(0, head);
+		for (int i = 0; i < length; i++)
+		{
+			float v = (float)pulse[i];
+			sum[i] += (count == frames) ? v - pNew[i] : v;
+			pNew[i] = v;
+		}
+		head = (head + 1) % frames;
+		if (count < frames)
+			count++;
+
+		if (image_wanted)
+		{
+			memcpy(image.raw_ptr(), line_pulses, sizeof(uint16_t) * image.length());
+			image_wanted = false;
+		}
+		sequence++;
+	}
+
+	// Consumer: rolling mean & envelope (length samples each) & 8-bit line image (alines x length), false if nothing new
+	bool fetch(float* mean, float* min, float* max, uint8_t* line_image)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		if ((count == 0) || (sequence == fetched))
+			return false;
+		fetched = sequence;
+
+		float inv = 1.0f / (float)count;
+		for (int i = 0; i < length; i++)
+		{
+			float _min = FLT_MAX, _max = -FLT_MAX;
+			for (int j = 0; j < count; j++)
+			{
+				float v = ring(i, j);
+				if (v < _min) _min = v;
+				if (v > _max) _max = v;
+			}
+			mean[i] = sum[i] * inv;
+			min[i] = _min;
+			max[i] = _max;
+		}
+
+		if (line_image)
+		{
+			for (int i = 0; i < image.length(); i++)
+				line_image[i] = (uint8_t)(image.raw_ptr()[i] >> 8);
+			image_wanted = true;
+		}
+
+		return true;
+	}
+
+private:
+	int length, alines, frames;
+	int count, head;
+	uint64_t sequence, fetched;
+	std::mutex mtx;
+
+	np::FloatArray2 ring; // last frames (length x frames)
+	np::FloatArray sum;
+	np::Uint16Array2 image; // pulses of the selected line (length x alines)
+
+	std::atomic<bool> enabled;
+	bool image_wanted;
+	std::atomic<int> line, aline;
+};
+
+#endif // PULSE_MONITOR_H
@@ -0,0 +1,131 @@
+#ifndef ROI_STATS_H
+#define ROI_STATS_H
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+#include <emmintrin.h>
+
+#define ROI_NONE	0
+#define ROI_RECT	1
+#define ROI_LINE	2
+
+
+struct RoiStatistics
+{
+	float mean, std, min, max;
+	int n;
+};
+
+// Statistics over a rectangular ROI & profile along a line of float images (image coordinates)
+// Row-wise SSE reductions restricted to the ROI (row sums accumulated in double), bilinear profile sampling.
+class RoiStats
+{
+public:
+	RoiStats() : mode(ROI_NONE), x0(0), y0(0), x1(0), y1(0)
+	{
+	}
+
+	~RoiStats()
+	{
+	}
+
+public:
+	void setMode(int _mode) { mode = _mode; }
+	int getMode() const { return mode; }
+
+	// Rect: (x0, y0) - (x1, y1) corners (inclusive), line: end points
+	void setPoints(int _x0, int _y0, int _x1, int _y1)
+	{
+		x0 = _x0; y0 = _y0; x1 = _x1; y1 = _y1;
+	}
+
+	bool isValid() const { return (mode != ROI_NONE) && ((x0 != x1) || (y0 != y1)); }
+
+	int getProfileLength() const { return std::max(std::abs(x1 - x0), std::abs(y1 - y0)) + 1; }
+
+	RoiStatistics statistics(const float* image, int width, int height) const
+	{
+		RoiStatistics s = { 0.0f, 0.0f, 0.0f, 0.0f, 0 };
+
+		int left = std::max(std::min(x0, x1), 0), right = std::min(std::max(x0, x1), width - 1);
+		int top = std::max(std::min(y0, y1), 0), bottom = std::min(std::max(y0, y1), height - 1);
+		if ((left > right) || (top > bottom))
+			return s;
+
+		double sum = 0.0, sumsq = 0.0;
+		float _min = FLT_MAX, _max = -FLT_MAX;
+		for (int i = top; i <= bottom; i++)
+		{
+			const float* row = image + i * width;
+
+			__m128 vsum = _mm_setzero_ps(), vsq = _mm_setzero_ps();
+			__m128 vmin = _mm_set1_ps(FLT_MAX), vmax = _mm_set1_ps(-FLT_MAX);
+			int j = left;
+			for (; j + 4 <= right + 1; j += 4)
+			{
+				__m128 v = _mm_loadu_ps(row + j);
+				vsum = _mm_add_ps(vsum, v);
+				vsq = _mm_add_ps(vsq, _mm_mul_ps(v, v));
+				vmin = _mm_min_ps(vmin, v);
+				vmax = _mm_max_ps(vmax, v);
+			}
+
+			float a[4], b[4], c[4], d[4];
+			_mm_storeu_ps(a, vsum); _mm_storeu_ps(b, vsq); _mm_storeu_ps(c, vmin); _mm_storeu_ps(d, vmax);
+			float row_sum = (a[0] + a[1]) + (a[2] + a[3]);
+			float row_sq = (b[0] + b[1]) + (b[2] + b[3]);
+			for (int k = 0; k < 4; k++)
+			{
+				_min = std::min(_min, c[k]);
+				_max = std::max(_max, d[k]);
+			}
+			for (; j <= right; j++)
+			{
+				float v = row[j];
+				row_sum += v; row_sq += v * v;
+				_min = std::min(_min, v);
+				_max = std::max(_max, v);
+			}
+
+			sum += row_sum;
+			sumsq += row_sq;
+		}
+
+		s.n = (right - left + 1) * (bottom - top + 1);
+		double mean = sum / s.n;
+		s.mean = (float)mean;
+		s.std = (float)sqrt(std::max(sumsq / s.n - mean * mean, 0.0));
+		s.min = _min;
+		s.max = _max;
+
+		return s;
+	}
+
+	// dst: getProfileLength() samples
+	void profile(const float* image, int width, int height, float* dst) const
+	{
+		int len = getProfileLength();
+		float dx = (len > 1) ? (float)(x1 - x0) / (float)(len - 1) : 0.0f;
+		float dy = (len > 1) ? (float)(y1 - y0) / (float)(len - 1) : 0.0f;
+
+		for (int i = 0; i < len; i++)
+		{
+			float x = std::min(std::max((float)x0 + i * dx, 0.0f), (float)(width - 1));
+			float y = std::min(std::max((float)y0 + i * dy, 0.0f), (float)(height - 1));
+			int ix = std::min((int)x, width - 2), iy = std::min((int)y, height - 2);
+			float fx = x - ix, fy = y - iy;
+
+			const float* p = image + iy * width + ix;
+			dst[i] = (1 - fy) * ((1 - fx) * p[0] + fx * p[1]) + fy * ((1 - fx) * p[width] + fx * p[width + 1]);
+		}
+	}
+
+private:
+	int mode;
+	int x0, y0, x1, y1;
+};
+
+#endif // ROI_STATS_H
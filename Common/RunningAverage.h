@@ -0,0 +1,178 @@
+#ifndef RUNNING_AVERAGE_H
+#define RUNNING_AVERAGE_H
+
+#include <iostream>
+#include <atomic>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include "array.h"
+
+#define AVERAGING_BLOCK			0
+#define AVERAGING_EXPONENTIAL	1
+#define AVERAGING_SLIDING		2
+
+
+// Running image average refreshed on every (accumulated) frame at a constant per-frame cost
+// - exponential: ema += a * (frame - ema), a = max(1 / n, 1 / N) (cumulative average until N frames)
+// - sliding: sum over a ring of the last N frames, updated by adding the new and subtracting the oldest frame
+//   (rebuilt from the ring once per N frames, so that rounding errors do not build up)
+// Mode & window changes are requested by the UI thread and applied by the image formation thread (applyRequest).
+class RunningAverage
+{
+public:
+	RunningAverage() : width(0), height(0), frames(0), mode(AVERAGING_BLOCK), count(0), head(0), age(0),
+		requestedMode(AVERAGING_BLOCK), requestedFrames(0)
+	{
+	}
+
+	~RunningAverage()
+	{
+	}
+
+public:
+	void initialize(int _width, int _height, int _frames, int _mode)
+	{
+		mode = _mode;
+		frames = (_frames > 0) ? _frames : 1;
+
+		if ((width != _width) || (height != _height))
+		{
+			width = _width;
+			height = _height;
+			image = np::FloatArray2(width, height);
+		}
+
+		if ((mode == AVERAGING_SLIDING) && ((ring.size(0) != width * height) || (ring.size(1) != frames)))
+			ring = np::FloatArray2(width * height, frames);
+		else if (mode != AVERAGING_SLIDING)
+			ring = np::FloatArray2();
+
+		reset();
+	}
+
+	// Mode & window change, requested by the UI thread
+	void request(int _frames, int _mode)
+	{
+		requestedMode = _mode;
+		requestedFrames = (_frames > 0) ? _frames : 1;
+	}
+
+	// Image formation thread: re-initializes for the requested mode & window (before the frame is pushed)
+	bool applyRequest()
+	{
+		int _frames = requestedFrames.exchange(0);
+		if (!_frames || !width)
+			return false;
+
+		initialize(width, height, _frames, requestedMode);
+		return true;
+	}
+
+	void reset()
+	{
+		count = 0;
+		head = 0;
+		age = 0;
+		if (image.length())
+			memset(image.raw_ptr(), 0, sizeof(float) * image.length());
+	}
+
+	// Adds a frame (cleared in the same pass for the next accumulation)
+	void push(float* frame)
+	{
+		bool full = (count == frames);
+		float alpha = 1.0f / (float)((count < frames) ? count + 1 : frames);
+		float* pImage = image.raw_ptr();
+		float* pOld = (mode == AVERAGING_SLIDING) ? &ring(0, head) : nullptr;
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)height),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			{
+				int offset = (int)i * width;
+				if (mode == AVERAGING_SLIDING)
+				{
+					if (full)
+					{
+						for (int j = offset; j < offset + width; j++)
+						{
+							pImage[j] += frame[j] - pOld[j];
+							pOld[j] = frame[j];
+							frame[j] = 0.0f;
+						}
+					}
+					else
+					{
+						for (int j = offset; j < offset + width; j++)
+						{
+							pImage[j] += frame[j];
+							pOld[j] = frame[j];
+							frame[j] = 0.0f;
+						}
+					}
+				}
+				else
+				{
+					for (int j = offset; j < offset + width; j++)
+					{
+						pImage[j] += alpha * (frame[j] - pImage[j]);
+						frame[j] = 0.0f;
+					}
+				}
+			}
+		});
+
+		if (mode == AVERAGING_SLIDING)
+			head = (head + 1) % frames;
+		if (count < frames)
+			count++;
+		age = (mode == AVERAGING_SLIDING) ? 0.5 * count : (1.0 - alpha) * (age + 1.0) + 0.5 * alpha;
+
+		if ((mode == AVERAGING_SLIDING) && (head == 0) && (frames > 1))
+			rebuild();
+	}
+
+	np::FloatArray2& getImage() { return image; }
+	float getScale() const { return ((mode == AVERAGING_SLIDING) && (count > 0)) ? 1.0f / (float)count : 1.0f; }
+	bool isFull() const { return count == frames; }
+	int getCount() const { return count; }
+	double getLag() const { return age; } // mean age of the averaged frames (frame periods, N - 1/2 for a settled exponential)
+
+private:
+	// Running sum recomputed from the ring (amortized over N frames)
+	void rebuild()
+	{
+		float* pImage = image.raw_ptr();
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)height),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			{
+				int offset = (int)i * width;
+				memcpy(pImage + offset, &ring(offset, 0), sizeof(float) * width);
+				for (int k = 1; k < frames; k++)
+				{
+					const float* pFrame = &ring(offset, k);
+					for (int j = 0; j < width; j++)
+						pImage[offset + j] += pFrame[j];
+				}
+			}
+		});
+	}
+
+private:
+	int width, height;
+	int frames, mode;
+	int count, head;
+	double age;
+
+	np::FloatArray2 image; // running sum (sliding) or average (exponential)
+	np::FloatArray2 ring; // last N frames (sliding)
+
+	std::atomic<int> requestedMode;
+	std::atomic<int> requestedFrames;
+};
+
+#endif // RUNNING_AVERAGE_H
@@ -0,0 +1,127 @@
+#ifndef SCAN_COMPENSATION_H
+#define SCAN_COMPENSATION_H
+
+#include <iostream>
+
+#include <immintrin.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include "array.h"
+
+
+// CRS (resonant scanner) nonlinearity compensation (the galvo shift is applied when the lines are accumulated)
+// dst(x, y) = w0(x) * src(i(x), y) + w1(x) * src(i(x) + 1, y)
+// The compensation index file is compiled once into an integer index & weight table,
+// and the gather is vectorized with AVX2 when available (SSE2 otherwise: 4 outputs per two set loads).
+class ScanCompensation
+{
+public:
+	ScanCompensation() : width(0), height(0), enabled(false)
+	{
+	}
+
+	~ScanCompensation()
+	{
+	}
+
+public:
+	void initialize(int _width, int _height)
+	{
+		width = _width;
+		height = _height;
+
+		index = np::Array<int>(width);
+		weight0 = np::FloatArray(width);
+		weight1 = np::FloatArray(width);
+		buffer = np::FloatArray2(width, height);
+
+		reset();
+	}
+
+	// Identity (plain copy)
+	void reset()
+	{
+		enabled = false;
+		for (int i = 0; i < width; i++)
+		{
+			index[i] = (i < width - 1) ? i : width - 2;
+			weight0[i] = (i < width - 1) ? 1.0f : 0.0f;
+			weight1[i] = 1.0f - weight0[i];
+		}
+	}
+
+	// Table compile: fractional source index (as in crs_comp_idx.txt: index & weight of the left sample)
+	void setTable(const float* comp_index, const float* comp_weight)
+	{
+		for (int i = 0; i < width; i++)
+		{
+			int idx = (int)comp_index[i];
+			float w = comp_weight[i];
+			if (idx < 0) { idx = 0; w = 1.0f; }
+			if (idx >= width - 1) { idx = width - 2; w = 0.0f; } // last sample only
+
+			index[i] = idx;
+			weight0[i] = w;
+			weight1[i] = 1.0f - w;
+		}
+		enabled = true;
+	}
+
+	bool isEnabled() const { return enabled; }
+
+	// Pre-allocated source plane (the image is formed here, then compensated into the destination)
+	float* getBuffer() { return buffer.raw_ptr(); }
+
+	void operator() (const float* src, float* dst)
+	{
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)height),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			{
+				const float* pSrc = src + (int)i * width;
+				float* pDst = dst + (int)i * width;
+
+				if (!enabled)
+				{
+					memcpy(pDst, pSrc, sizeof(float) * width);
+					continue;
+				}
+
+				int j = 0;
+#if defined(__AVX2__)
+				for (; j + 8 <= width; j += 8)
+				{
+					__m256i idx = _mm256_loadu_si256((const __m256i*)&index[j]);
+					__m256 v0 = _mm256_i32gather_ps(pSrc, idx, 4);
+					__m256 v1 = _mm256_i32gather_ps(pSrc + 1, idx, 4);
+					__m256 out = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&weight0[j]), v0), _mm256_mul_ps(_mm256_loadu_ps(&weight1[j]), v1));
+					_mm256_storeu_ps(pDst + j, out);
+				}
+#else
+				for (; j + 4 <= width; j += 4)
+				{
+					const int* idx = &index[j];
+					__m128 v0 = _mm_set_ps(pSrc[idx[3]], pSrc[idx[2]], pSrc[idx[1]], pSrc[idx[0]]);
+					__m128 v1 = _mm_set_ps(pSrc[idx[3] + 1], pSrc[idx[2] + 1], pSrc[idx[1] + 1], pSrc[idx[0] + 1]);
+					__m128 out = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&weight0[j]), v0), _mm_mul_ps(_mm_loadu_ps(&weight1[j]), v1));
+					_mm_storeu_ps(pDst + j, out);
+				}
+#endif
+				for (; j < width; j++)
+					pDst[j] = weight0[j] * pSrc[index[j]] + weight1[j] * pSrc[index[j] + 1];
+			}
+		});
+	}
+
+private:
+	int width, height;
+	bool enabled;
+
+	np::Array<int> index;
+	np::FloatArray weight0, weight1;
+	np::FloatArray2 buffer;
+};
+
+#endif // SCAN_COMPENSATION_H
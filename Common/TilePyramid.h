@@ -0,0 +1,162 @@
+#ifndef TILE_PYRAMID_H
+#define TILE_PYRAMID_H
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include <QImage>
+#include <QVector>
+#include <QRgb>
+#include <QString>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+
+#include <emmintrin.h>
+
+
+// Multi-resolution pyramid of a stitched mosaic (8-bit indexed BMP tiles on disk)
+// Level 0 tiles are the acquired images (grid x, y), a level k tile covers 2^k x 2^k of them at 1/2^k scale.
+// Built incrementally: each added image updates one quadrant of its parent at every level (2x2 box
+// averaging of the child), the last parent of each level is kept in memory to save re-reading it.
+// Layout: <path>/pyramid.ini & <path>/<level>/<y>_<x>.bmp
+class TilePyramid
+{
+public:
+	TilePyramid() : nx(0), ny(0), width(0), height(0), levels(0)
+	{
+	}
+
+	~TilePyramid()
+	{
+	}
+
+public:
+	bool initialize(const QString& _path, int _nx, int _ny, int _width, int _height, const QVector<QRgb>& _colortable)
+	{
+		path = _path;
+		nx = _nx; ny = _ny;
+		width = _width; height = _height;
+		colortable = _colortable;
+
+		levels = 1;
+		while ((1 << (levels - 1)) < std::max(nx, ny))
+			levels++;
+
+		parents.assign(levels, QImage());
+		parent_x.assign(levels, -1); parent_y.assign(levels, -1);
+
+		for (int i = 0; i < levels; i++)
+			if (!QDir().mkpath(path + QString("/%1").arg(i)))
+				return false;
+
+		QFile file(path + "/pyramid.ini");
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+			return false;
+
+		QTextStream out(&file);
+		out << "[pyramid]\n";
+		out << "nx=" << nx << "\n" << "ny=" << ny << "\n";
+		out << "width=" << width << "\n" << "height=" << height << "\n";
+		out << "levels=" << levels << "\n";
+		file.close();
+
+		return true;
+	}
+
+	int getLevels() const { return levels; }
+
+	static QString tileName(const QString& _path, int level, int x, int y)
+	{
+		return _path + QString("/%1/%2_%3.bmp").arg(level).arg(y, 3, 10, (QChar)'0').arg(x, 3, 10, (QChar)'0');
+	}
+
+	// Acquired image (width x height, row stride in bytes) at grid position (x, y)
+	bool add(int x, int y, const uint8_t* image, int stride)
+	{
+		if ((x < 0) || (x >= nx) || (y < 0) || (y >= ny))
+			return false;
+
+		QImage child = newTile();
+		for (int i = 0; i < height; i++)
+			memcpy(child.scanLine(i), image + i * stride, width);
+		if (!child.save(tileName(path, 0, x, y), "bmp"))
+			return false;
+
+		for (int k = 1; k < levels; k++)
+		{
+			int px = x >> k, py = y >> k;
+			int qx = (x >> (k - 1)) & 1, qy = (y >> (k - 1)) & 1;
+
+			// Parent: kept from the previous image, read back or new
+			QImage& parent = parents[k];
+			if ((parent_x[k] != px) || (parent_y[k] != py))
+			{
+				QImage img;
+				if (img.load(tileName(path, k, px, py), "bmp") && (img.format() == QImage::Format_Indexed8)
+					&& (img.width() == width) && (img.height() == height))
+					parent = img;
+				else
+					parent = newTile();
+				parent_x[k] = px; parent_y[k] = py;
+			}
+
+			downsample(child, parent, qx * (width / 2), qy * (height / 2));
+			if (!parent.save(tileName(path, k, px, py), "bmp"))
+				return false;
+
+			child = parent;
+		}
+
+		return true;
+	}
+
+private:
+	QImage newTile() const
+	{
+		QImage img(width, height, QImage::Format_Indexed8);
+		img.setColorTable(colortable);
+		img.fill(0);
+		return img;
+	}
+
+	// 2x2 box average of src into dst at (ox, oy) (width / 2 x height / 2)
+	void downsample(const QImage& src, QImage& dst, int ox, int oy) const
+	{
+		int w = width / 2, h = height / 2;
+		for (int i = 0; i < h; i++)
+		{
+			const uint8_t* r0 = src.constScanLine(2 * i);
+			const uint8_t* r1 = src.constScanLine(2 * i + 1);
+			uint8_t* d = dst.scanLine(oy + i) + ox;
+
+			int j = 0;
+			const __m128i mask = _mm_set1_epi16(0x00ff);
+			for (; j + 8 <= w; j += 8)
+			{
+				// Vertical sum of 16 pixels, then pairwise horizontal sum (rounded)
+				__m128i a = _mm_loadu_si128((const __m128i*)(r0 + 2 * j));
+				__m128i b = _mm_loadu_si128((const __m128i*)(r1 + 2 * j));
+				__m128i even = _mm_add_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+				__m128i odd = _mm_add_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+				__m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(even, odd), _mm_set1_epi16(2)), 2);
+				_mm_storel_epi64((__m128i*)(d + j), _mm_packus_epi16(sum, sum));
+			}
+			for (; j < w; j++)
+				d[j] = (uint8_t)((r0[2 * j] + r0[2 * j + 1] + r1[2 * j] + r1[2 * j + 1] + 2) >> 2);
+		}
+	}
+
+private:
+	QString path;
+	int nx, ny;
+	int width, height;
+	int levels;
+	QVector<QRgb> colortable;
+
+	std::vector<QImage> parents; // last parent tile of each level
+	std::vector<int> parent_x, parent_y;
+};
+
+#endif // TILE_PYRAMID_H
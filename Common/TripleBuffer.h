@@ -0,0 +1,57 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+
+// Latest-wins mailbox between a producer and a consumer thread.
+// The producer writes into the back buffer and publishes it, the consumer takes the
+// most recently published buffer as its front buffer. Neither side ever blocks, the
+// consumer never sees a half-written buffer, and unconsumed frames are overwritten.
+// (Producers must be serialized by the caller.)
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : state(1), back(0), front(2), latest(1)
+	{
+	}
+
+	~TripleBuffer()
+	{
+	}
+
+public:
+	// Producer side
+	T& getBack() { return buffer[back]; }
+	const T& getLatest() const { return buffer[latest]; } // last published (not written until the next publish)
+
+	void publish()
+	{
+		latest = back;
+		back = state.exchange(back | FRESH) & INDEX;
+	}
+
+	// Consumer side
+	T& getFront() { return buffer[front]; }
+
+	bool update()
+	{
+		if (!(state.load() & FRESH))
+			return false;
+
+		front = state.exchange(front) & INDEX;
+		return true;
+	}
+
+public:
+	T buffer[3];
+
+private:
+	enum { INDEX = 0x3, FRESH = 0x4 };
+
+	std::atomic<int> state; // middle buffer index | fresh flag
+	int back, front, latest;
+};
+
+#endif // TRIPLE_BUFFER_H
@@ -1,59 +1,147 @@
 #ifndef _MEDFILT_H_
 #define _MEDFILT_H_
 
-#include <ippi.h>
-#include <ipps.h>
-#include <ippcore.h>
+#include <algorithm>
+
+#include <emmintrin.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 #include "array.h"
 
 
+// 3x3 / 5x5 median filter on float images (out-of-place, replicated border)
+// 4 pixels at a time: each SIMD lane runs a min/max selection network over its neighborhood
+// (forgetful selection: the min & max of r+1 candidates can never be the median, so both are
+// dropped and the next sample is taken, until a single candidate remains).
 class medfilt
 {
 public:
-	medfilt()
+	medfilt() : width(0), height(0), kernel(0)
 	{
 	};
 
-	medfilt(int _width, int _height, int _kernelx, int _kernely) :
-		width(_width), height(_height), kernelx(_kernelx), kernely(_kernely)
+	medfilt(int _width, int _height, int _kernel) :
+		width(_width), height(_height), kernel(_kernel)
 	{
-		RoiSize = { width, height };
-		MaskSize = { kernelx, kernely };
-
-		ippiFilterMedianBorderGetBufferSize(RoiSize, MaskSize, ipp8u, 1, &BufferSize);
-		MemBuffer8u = np::Array<uint8_t>(BufferSize);
-		DstBuffer8u = np::Array<Ipp8u, 2>(width, height);
-
-		ippiFilterMedianBorderGetBufferSize(RoiSize, MaskSize, ipp32f, 1, &BufferSize);
-		MemBuffer32f = np::Array<uint8_t>(BufferSize);
-		DstBuffer32f = np::Array<Ipp32f, 2>(width, height);
 	};
 
 	~medfilt()
 	{
 	};
 
-	void operator() (Ipp8u* pSrcDst)
+	int getKernel() const { return kernel; }
+	void setKernel(int _kernel) { kernel = _kernel; }
+
+	void operator() (const float* pSrc, float* pDst)
+	{
+		if (kernel == 5)
+			filter<5>(pSrc, pDst);
+		else if (kernel == 3)
+			filter<3>(pSrc, pDst);
+		else
+			memcpy(pDst, pSrc, sizeof(float) * width * height);
+	};
+
+private:
+	template <int K>
+	void filter(const float* pSrc, float* pDst)
+	{
+		const int R = K / 2;
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)height),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t i = r.begin(); i != r.end(); ++i)
+			{
+				// Row pointers (replicated border)
+				const float* rows[K];
+				for (int k = 0; k < K; k++)
+					rows[k] = pSrc + std::min(std::max((int)i + k - R, 0), height - 1) * width;
+				float* dst = pDst + (int)i * width;
+
+				// Interior: vectorized
+				int j = R;
+				for (; j + 4 <= width - R; j += 4)
+				{
+					__m128 v[K * K];
+					for (int y = 0; y < K; y++)
+						for (int x = 0; x < K; x++)
+							v[y * K + x] = _mm_loadu_ps(rows[y] + j + x - R);
+					_mm_storeu_ps(dst + j, select<K * K>(v));
+				}
+
+				// Borders & remainder: scalar
+				for (int jj = 0; jj < width; jj++)
+				{
+					if ((jj >= R) && (jj < j)) jj = j;
+					if (jj >= width) break;
+
+					float v[K * K];
+					for (int y = 0; y < K; y++)
+						for (int x = 0; x < K; x++)
+							v[y * K + x] = rows[y][std::min(std::max(jj + x - R, 0), width - 1)];
+					std::nth_element(v, v + K * K / 2, v + K * K);
+					dst[jj] = v[K * K / 2];
+				}
+			}
+		});
+	}
+
+	// One selection step over M candidates (min & max dropped, next sample taken)
+	template <int N, int M, int NEXT>
+	struct Select
 	{
-		ippiFilterMedianBorder_8u_C1R(pSrcDst, sizeof(Ipp8u) * RoiSize.width, DstBuffer8u, sizeof(Ipp8u) * RoiSize.width, RoiSize, MaskSize, ippBorderRepl, 0, MemBuffer8u);
-		memcpy(pSrcDst, DstBuffer8u, sizeof(Ipp8u) * width * height);
+		static inline __m128 run(__m128* a, const __m128* v)
+		{
+			minmax<M>(a);
+			a[0] = a[M - 2];
+			a[M - 2] = v[NEXT];
+			return Select<N, M - 1, NEXT + 1>::run(a, v);
+		}
 	};
 
-	void operator() (Ipp32f* pSrcDst)
+	template <int N, int M>
+	struct Select<N, M, N>
 	{
-		ippiFilterMedianBorder_32f_C1R(pSrcDst, sizeof(Ipp32f) * RoiSize.width, DstBuffer32f, sizeof(Ipp32f) * RoiSize.width, RoiSize, MaskSize, ippBorderRepl, 0, MemBuffer32f);
-		memcpy(pSrcDst, DstBuffer32f, sizeof(Ipp32f) * width * height);
+		static inline __m128 run(__m128* a, const __m128*)
+		{
+			minmax<M>(a);
+			return a[1];
+		}
 	};
 
+	// Min to a[0], max to a[M - 1]
+	template <int M>
+	static inline void minmax(__m128* a)
+	{
+		for (int i = 1; i < M; i++)
+		{
+			__m128 lo = _mm_min_ps(a[0], a[i]);
+			a[i] = _mm_max_ps(a[0], a[i]);
+			a[0] = lo;
+		}
+		for (int i = 1; i < M - 1; i++)
+		{
+			__m128 hi = _mm_max_ps(a[i], a[M - 1]);
+			a[i] = _mm_min_ps(a[i], a[M - 1]);
+			a[M - 1] = hi;
+		}
+	}
+
+	template <int N>
+	static inline __m128 select(const __m128* v)
+	{
+		const int M = N / 2 + 2; // rank of the median + 1
+		__m128 a[M];
+		for (int i = 0; i < M; i++)
+			a[i] = v[i];
+
+		return Select<N, M, M>::run(a, v);
+	}
+
 private:
-	int width, height, kernelx, kernely;
-	IppiSize RoiSize, MaskSize;
-	Ipp32s BufferSize;
-	np::Array<uint8_t> MemBuffer8u;
-	np::Array<uint8_t> MemBuffer32f;
-	np::Array<Ipp8u, 2> DstBuffer8u;
-	np::Array<Ipp32f, 2> DstBuffer32f;
+	int width, height, kernel;
 };
 
 #endif
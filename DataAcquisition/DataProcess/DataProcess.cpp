@@ -1,8 +1,11 @@
 
 #include "DataProcess.h"
 
+#include <QTextStream>
 
-DataProcess::DataProcess()
+
+DataProcess::DataProcess() : _template_staged(false), _staged_unmixing(false), _unmix_staged(false), _capture_requested(false),
+    _editing(false), _prefix_filling(false), _prefix_valid(false)
 {
 }
 
@@ -11,13 +14,51 @@ DataProcess::~DataProcess()
 }
 
 
-void DataProcess::operator() (FloatArray2& intensity, Uint16Array2& pulse)
+void DataProcess::operator() (FloatArray2& intensity, Uint16Array2& pulse, int aline_offset, int image_alines, FloatArray2* lifetime)
 {
+    // 0. Parameters staged by the UI thread
+    applyStagedParameters();
+
     // 1. Crop and resize pulse data
-    _operator(pulse, _params);
+    bool editing = _editing && (aline_offset >= 0);
+    _operator(pulse, _params, lifetime != nullptr, editing);
+
+    // 1-1. Pulse template requested by the UI thread (from this chunk)
+    if (_capture_requested)
+        captureStagedTemplate();
 
     // 2. Get intensity
     memcpy(intensity, _operator.intensity, sizeof(float) * _operator.intensity.length());
+
+    // 2-1. Intensity-weighted mean delay (summed with the intensity over accumulation, divided at image formation)
+    if (lifetime)
+    {
+        ippsThreshold_LT_32f(_operator.intensity.raw_ptr(), lifetime->raw_ptr(), lifetime->length(), 0.0f);
+        ippsMul_32f_I(_operator.delay.raw_ptr(), lifetime->raw_ptr(), lifetime->length());
+    }
+
+    // 3. Cache prefix sums of the current image (complete from its first chunk)
+    if (editing)
+    {
+        std::unique_lock<std::mutex> lock(_prefix_mtx);
+        if (!_editing) return; // disabled during this chunk
+
+        const FloatArray2& prefix = _operator.prefix;
+        if ((_prefix_cache.size(0) != prefix.size(0)) || (_prefix_cache.size(1) != image_alines))
+        {
+            _prefix_cache = std::move(FloatArray2(prefix.size(0), image_alines));
+            _prefix_filling = _prefix_valid = false;
+        }
+
+        if (aline_offset + prefix.size(1) <= image_alines)
+        {
+            memcpy(&_prefix_cache(0, aline_offset), prefix.raw_ptr(), sizeof(float) * prefix.length());
+            if (aline_offset == 0)
+                _prefix_filling = true;
+            if (aline_offset + prefix.size(1) == image_alines)
+                _prefix_valid = _prefix_filling;
+        }
+    }
 }
 
 
@@ -33,4 +74,220 @@ void DataProcess::setParameters(Configuration* pConfig)
     for (int i = 0; i < 5; i++)
 		_params.ch_start_ind[i] = pConfig->flimChStartInd[i];
 //    _params.ch_start_ind[5] = _params.ch_start_ind[3] + FLIM_CH_START_5;
+
+    for (int i = 0; i < 4; i++)
+        _params.intensity_mode[i] = pConfig->channelIntensityMode[i];
+    _params.photon_thres = pConfig->photonCountThres;
+    loadPulseTemplate("pulse_template.txt");
+
+    setUnmixing(pConfig->crossTalkMatrix, pConfig->crossTalkUnmixing);
+}
+
+
+void DataProcess::applyStagedParameters()
+{
+    // Processing thread: swapped between chunks (the kernel is rebuilt at the top of the operator)
+    if (_template_staged)
+    {
+        std::unique_lock<std::mutex> lock(_staged_mtx);
+        _params.pulse_template = _staged_template;
+        _template_staged = false;
+        _operator.template_changed = true;
+    }
+
+    if (_unmix_staged)
+    {
+        std::unique_lock<std::mutex> lock(_staged_mtx);
+        memcpy(_params.unmix_matrix, _staged_unmix, sizeof(float) * 16);
+        _params.unmixing = _staged_unmixing;
+        _unmix_staged = false;
+    }
+}
+
+void DataProcess::captureStagedTemplate()
+{
+    // Processing thread: average the (bg subtracted) pulses of the chunk just processed
+    const FloatArray2& src = _operator.crop_src0;
+    if (src.length() == 0) return;
+
+    FloatArray templ(src.size(0));
+    memset(templ.raw_ptr(), 0, sizeof(float) * templ.length());
+    for (int i = 0; i < src.size(1); i++)
+        ippsAdd_32f_I(&src(0, i), templ.raw_ptr(), templ.length());
+    ippsDivC_32f_I((Ipp32f)src.size(1), templ.raw_ptr(), templ.length());
+
+    _params.pulse_template = templ;
+    _operator.template_changed = true;
+
+    QString filename;
+    {
+        std::unique_lock<std::mutex> lock(_staged_mtx);
+        filename = _capture_filename;
+        _capture_requested = false;
+    }
+    savePulseTemplate(filename.toLocal8Bit().constData());
+
+    SendStatusMessage("Matched filter pulse template is captured.");
+}
+
+void DataProcess::capturePulseTemplate(const char* filename)
+{
+    // Captured & saved by the processing thread from the next chunk
+    std::unique_lock<std::mutex> lock(_staged_mtx);
+    _capture_filename = filename;
+    _capture_requested = true;
+}
+
+bool DataProcess::loadPulseTemplate(const char* filename)
+{
+    QFile file(filename);
+    if (false == file.open(QIODevice::ReadOnly))
+        return false;
+
+    std::vector<float> values;
+    QTextStream in(&file);
+    while (!in.atEnd())
+    {
+        QString line = in.readLine();
+        if (!line.isEmpty())
+            values.push_back(line.toFloat());
+    }
+    file.close();
+
+    FloatArray templ((int)values.size());
+    memcpy(templ.raw_ptr(), values.data(), sizeof(float) * values.size());
+
+    std::unique_lock<std::mutex> lock(_staged_mtx);
+    _staged_template = templ;
+    _template_staged = true;
+
+    return true;
+}
+
+bool DataProcess::savePulseTemplate(const char* filename)
+{
+    QFile file(filename);
+    if (false == file.open(QIODevice::WriteOnly))
+        return false;
+
+    QTextStream out(&file);
+    for (int i = 0; i < _params.pulse_template.length(); i++)
+        out << QString::number(_params.pulse_template(i), 'f', 4) << "\n";
+    file.close();
+
+    return true;
+}
+
+bool DataProcess::setUnmixing(const float* crosstalk, bool enabled)
+{
+    if (!enabled)
+    {
+        // Off from the next chunk (matrix kept)
+        std::unique_lock<std::mutex> lock(_staged_mtx);
+        if (!_unmix_staged)
+            memcpy(_staged_unmix, _params.unmix_matrix, sizeof(float) * 16);
+        _staged_unmixing = false;
+        _unmix_staged = true;
+        return true;
+    }
+
+    // Observed = crosstalk * true, so true = inv(crosstalk) * observed
+    Matrix A(4, 4);
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            A(i + 1, j + 1) = crosstalk[4 * i + j];
+
+    try
+    {
+        Matrix invA = Inv(A);
+
+        float unmix[16];
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                unmix[4 * i + j] = invA(i + 1, j + 1);
+
+        // Whole matrix swapped in with the flag between chunks (no chunk unmixed with half-updated rows)
+        std::unique_lock<std::mutex> lock(_staged_mtx);
+        memcpy(_staged_unmix, unmix, sizeof(float) * 16);
+        _staged_unmixing = true;
+        _unmix_staged = true;
+    }
+    catch (Exception& e)
+    {
+        char msg[256];
+        sprintf(msg, "Invalid crosstalk matrix: %s", e.msg);
+        SendStatusMessage(msg);
+        return false;
+    }
+
+    return true;
+}
+
+void DataProcess::setEditingEnabled(bool enabled)
+{
+    std::unique_lock<std::mutex> lock(_prefix_mtx);
+    _editing = enabled;
+    _prefix_filling = _prefix_valid = false;
+}
+
+bool DataProcess::getCachedIntensity(FloatArray2& image, bool* channels)
+{
+    std::unique_lock<std::mutex> lock(_prefix_mtx);
+
+    int n_alines = _prefix_cache.size(1);
+    if (!_prefix_valid || (image.length() != 4 * n_alines))
+        return false;
+
+    // Only boxcar channels can be recovered from prefix sums
+    bool all_boxcar = true;
+    for (int j = 0; j < 4; j++)
+    {
+        channels[j] = (_params.intensity_mode[j] == INTENSITY_BOXCAR);
+        all_boxcar = all_boxcar && channels[j];
+    }
+
+    // Latest unmixing matrix & flag (staged or swapped in)
+    float unmix[16];
+    bool unmixing;
+    {
+        std::unique_lock<std::mutex> lock_staged(_staged_mtx);
+        memcpy(unmix, _unmix_staged ? _staged_unmix : _params.unmix_matrix, sizeof(float) * 16);
+        unmixing = _unmix_staged ? _staged_unmixing : _params.unmixing;
+    }
+    if (unmixing && !all_boxcar)
+        return false;
+
+    int ind[5];
+    for (int i = 0; i < 5; i++)
+    {
+        ind[i] = (int)round((float)_params.ch_start_ind[i] * _operator.ActualFactor);
+        ind[i] = (ind[i] < 0) ? 0 : ((ind[i] > _prefix_cache.size(0) - 1) ? _prefix_cache.size(0) - 1 : ind[i]);
+    }
+
+    FloatArray2 image0(image.raw_ptr(), n_alines, 4);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)n_alines),
+        [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t i = r.begin(); i != r.end(); ++i)
+        {
+            const float* psum = &_prefix_cache(0, (int)i);
+
+            float val[4];
+            for (int j = 0; j < 4; j++)
+                val[j] = (psum[ind[j + 1]] - psum[ind[j]]) / 65532.0f;
+
+            for (int j = 0; j < 4; j++)
+            {
+                if (!channels[j]) continue;
+                if (unmixing)
+                {
+                    const float* u = unmix + 4 * j;
+                    image0((int)i, j) = u[0] * val[0] + u[1] * val[1] + u[2] * val[2] + u[3] * val[3];
+                }
+                else
+                    image0((int)i, j) = val[j];
+            }
+        }
+    });
+
+    return true;
 }
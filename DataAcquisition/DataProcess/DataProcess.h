@@ -10,10 +10,16 @@
 #error("INTENSITY_THRES is not defined for FLIM processing.");
 #endif
 
+#define INTENSITY_BOXCAR            0
+#define INTENSITY_MATCHED_FILTER    1
+#define INTENSITY_PHOTON_COUNTING   2
+
 #include <iostream>
 #include <vector>
 #include <utility>
 #include <cmath>
+#include <mutex>
+#include <atomic>
 
 #include <QString>
 #include <QFile>
@@ -21,12 +27,15 @@
 #include <ipps.h>
 #include <ippi.h>
 
+#include <emmintrin.h>
+
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
 
 #include <mkl_df.h>
 
 #include <Common/array.h>
+#include <Common/matrix.h>
 #include <Common/callback.h>
 using namespace np;
 
@@ -39,12 +48,19 @@ struct FLIM_PARAMS
     float width_factor = 2.0f;
 
     int ch_start_ind[5] = { 0, };
+
+    int intensity_mode[4] = { INTENSITY_BOXCAR, };
+    FloatArray pulse_template; // averaged pulse (bg subtracted), nScans samples
+    float photon_thres = 1000.0f; // photon counting threshold above bg
+
+    bool unmixing = false;
+    float unmix_matrix[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 }; // inverse of crosstalk matrix (row-major)
 };
 
 struct OPERATOR
 {
 public:
-	OPERATOR() : scoeff(nullptr), nx(-1), initiated(false)
+	OPERATOR() : scoeff(nullptr), nx(-1), initiated(false), windows_changed(false), template_changed(false)
     {
     }
 
@@ -53,12 +69,17 @@ public:
         if (scoeff) delete[] scoeff;
     }
 
-    void operator() (const Uint16Array2 &src, const FLIM_PARAMS &pParams)
+    void operator() (const Uint16Array2 &src, const FLIM_PARAMS &pParams, bool lifetime = false, bool prefix_sums = false)
     {
         // 0. Initialize        
         int _nx = src.size(0); //pParams.ch_start_ind[4] - pParams.ch_start_ind[0];
         if ((nx != _nx) || !initiated)
             initialize(pParams, _nx, FLIM_SPLINE_FACTOR, src.size(1));
+        else if (windows_changed || template_changed)
+            setChannelWindows(pParams);
+
+        float thres = roundf(pParams.bg + pParams.photon_thres);
+        uint16_t photon_thres = (uint16_t)((thres < 1.0f) ? 1.0f : ((thres > 65535.0f) ? 65535.0f : thres));
 
         // 1. Convert data
 		int offset;
@@ -87,6 +108,16 @@ public:
             [&](const tbb::blocked_range<size_t>& r) {
             for (size_t i = r.begin(); i != r.end(); ++i)
             {
+                // Per-A-line prefix sums (for re-rendering with edited channel windows, only while editing)
+                float* psum = &prefix(0, (int)i);
+                if (prefix_sums)
+                {
+                    const float* pulse = &crop_src(0, (int)i);
+                    psum[0] = 0;
+                    for (int k = 0; k < nx; k++)
+                        psum[k + 1] = psum[k] + pulse[k];
+                }
+
                 ///DFTaskPtr task1 = nullptr;
 
                 ///dfsNewTask1D(&task1, nx, x, DF_UNIFORM_PARTITION, 1, &crop_src(0, (int)i), DF_MATRIX_STORAGE_ROWS);
@@ -102,13 +133,60 @@ public:
 					if (saturated((int)i, j) < 1)
 					{
 						offset = ch_start_ind1[j] - ch_start_ind1[0];
-                        ippsSum_32f(&crop_src(ch_start_ind1[j], (int)i), ch_start_ind1[j + 1] - ch_start_ind1[j], &intensity((int)i, j), ippAlgHintFast);
+                        int len = ch_start_ind1[j + 1] - ch_start_ind1[j];
+                        if (pParams.intensity_mode[j] == INTENSITY_MATCHED_FILTER)
+                            ippsDotProd_32f(&crop_src(ch_start_ind1[j], (int)i), &match_kernel(ch_start_ind1[j]), len, &intensity((int)i, j));
+                        else if (pParams.intensity_mode[j] == INTENSITY_PHOTON_COUNTING)
+                        {
+                            const uint16_t* pulse = &src(ch_start_ind1[j], (int)i);
+                            uint16_t prev = (ch_start_ind1[j] > 0) ? *(pulse - 1) : 0;
+                            intensity((int)i, j) = (float)countPhotons(pulse, len, prev, photon_thres);
+                        }
+                        else
+                            ippsSum_32f(&crop_src(ch_start_ind1[j], (int)i), len, &intensity((int)i, j), ippAlgHintFast);
 					}
+
+                    // Mean delay in the channel window (first moment, nsec from the window start)
+                    if (lifetime)
+                    {
+                        int start = ch_start_ind1[j], len = ch_start_ind1[j + 1] - ch_start_ind1[j];
+                        float sum = 0, m1 = 0;
+                        if (len > 0)
+                        {
+                            if (prefix_sums)
+                                sum = psum[start + len] - psum[start];
+                            else
+                                ippsSum_32f(&crop_src(start, (int)i), len, &sum, ippAlgHintFast);
+                            ippsDotProd_32f(&crop_src(start, (int)i), ramp.raw_ptr(), len, &m1);
+                        }
+                        delay((int)i, j) = (sum > 0) ? m1 / sum * pParams.samp_intv / ActualFactor : 0.0f;
+                    }
 				}
             }
         });
 
-		ippsDivC_32f_I(65532.0f, intensity.raw_ptr(), intensity.length());
+        // Photon counting channels are kept as counts per pixel
+        bool photon_counting = false;
+        for (int j = 0; j < 4; j++)
+        {
+            if (pParams.intensity_mode[j] != INTENSITY_PHOTON_COUNTING)
+                ippsDivC_32f_I(65532.0f, &intensity(0, j), (int)ny);
+            else
+                photon_counting = true;
+        }
+
+        // 5. Spectral crosstalk unmixing (channel-wise planes, normalized intensities only: suspended with photon counts)
+        if (pParams.unmixing && !photon_counting)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                const float* u = pParams.unmix_matrix + 4 * j;
+                ippsMulC_32f(&intensity(0, 0), u[0], &unmixed(0, j), (int)ny);
+                for (int k = 1; k < 4; k++)
+                    ippsAddProductC_32f(&intensity(0, k), u[k], &unmixed(0, j), (int)ny);
+            }
+            memcpy(intensity.raw_ptr(), unmixed.raw_ptr(), sizeof(float) * intensity.length());
+        }
     }
 
     void initialize(const FLIM_PARAMS& pParams, int _nx, int _upSampleFactor, int _alines)
@@ -122,15 +200,6 @@ public:
         srcSize = { (int)nx, (int)ny };
         dorder = 1;
 
-        /* Find pulse roi length for mean delay calculation */
-        for (int i = 0; i < 5; i++)
-            ch_start_ind1[i] = (int)round((float)pParams.ch_start_ind[i] * ActualFactor);
-
-        int diff_ind[4];
-        for (int i = 0; i < 4; i++)
-            diff_ind[i] = ch_start_ind1[i + 1] - ch_start_ind1[i];
-
-        ippsMin_32s(diff_ind, 4, &pulse_roi_length);
 //		char msg[256];
 //		sprintf(msg, "Initializing... %d", pulse_roi_length);
 //		SendStatusMessage(msg);
@@ -150,10 +219,100 @@ public:
 		
 		/* intensity */
 		intensity = std::move(FloatArray2((int)ny, 4));
+        unmixed = std::move(FloatArray2((int)ny, 4));
+
+        /* mean delay */
+        delay = std::move(FloatArray2((int)ny, 4));
+        memset(delay, 0, sizeof(float) * delay.length());
+        ramp = std::move(FloatArray((int)nx));
+        for (int i = 0; i < nx; i++)
+            ramp(i) = (float)i;
+
+        /* prefix sums */
+        prefix = std::move(FloatArray2((int)nx + 1, (int)ny));
+
+        /* matched filter kernel */
+        match_kernel = std::move(FloatArray((int)nx));
+
+        /* channel windows */
+        setChannelWindows(pParams);
 
         initiated = true;
     }
 
+    void setChannelWindows(const FLIM_PARAMS& pParams)
+    {
+        // Window edits only update indices & kernels (no reallocation)
+        windows_changed = false;
+
+        /* Find pulse roi length for mean delay calculation */
+        for (int i = 0; i < 5; i++)
+            ch_start_ind1[i] = (int)round((float)pParams.ch_start_ind[i] * ActualFactor);
+
+        int diff_ind[4];
+        for (int i = 0; i < 4; i++)
+            diff_ind[i] = ch_start_ind1[i + 1] - ch_start_ind1[i];
+
+        ippsMin_32s(diff_ind, 4, &pulse_roi_length);
+
+        setMatchedFilter(pParams);
+    }
+
+    void setMatchedFilter(const FLIM_PARAMS& pParams)
+    {
+        template_changed = false;
+
+        // Window-wise normalized template: for a pulse shaped like the template,
+        // the dot product gives the same value as the boxcar sum (same contrast range).
+        ippsSet_32f(1.0f, match_kernel.raw_ptr(), match_kernel.length());
+        if (pParams.pulse_template.length() != nx)
+            return;
+
+        for (int j = 0; j < 4; j++)
+        {
+            int len = ch_start_ind1[j + 1] - ch_start_ind1[j];
+            if (len <= 0) continue;
+
+            const float* templ = &pParams.pulse_template(ch_start_ind1[j]);
+            Ipp32f sum1, sum2;
+            ippsSum_32f(templ, len, &sum1, ippAlgHintFast);
+            ippsDotProd_32f(templ, templ, len, &sum2);
+
+            if (sum2 > 0)
+                ippsMulC_32f(templ, sum1 / sum2, &match_kernel(ch_start_ind1[j]), len);
+        }
+    }
+
+    static int countPhotons(const uint16_t* src, int len, uint16_t prev, uint16_t thres)
+    {
+        // Rising-edge threshold crossings: src[k] >= thres && src[k - 1] < thres
+        // (unsigned 16-bit compare is done as signed compare after flipping the sign bit)
+        if (len <= 0) return 0;
+
+        const __m128i sign = _mm_set1_epi16((short)0x8000);
+        const __m128i thr = _mm_xor_si128(_mm_set1_epi16((short)(thres - 1)), sign);
+        __m128i acc = _mm_setzero_si128();
+
+        int count = ((src[0] >= thres) && (prev < thres)) ? 1 : 0;
+        int k = 1;
+        for (; k + 8 <= len; k += 8)
+        {
+            __m128i cur = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + k)), sign);
+            __m128i pre = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + k - 1)), sign);
+            __m128i edge = _mm_andnot_si128(_mm_cmpgt_epi16(pre, thr), _mm_cmpgt_epi16(cur, thr));
+            acc = _mm_sub_epi16(acc, edge);
+        }
+        acc = _mm_add_epi16(acc, _mm_srli_si128(acc, 8));
+        acc = _mm_add_epi16(acc, _mm_srli_si128(acc, 4));
+        acc = _mm_add_epi16(acc, _mm_srli_si128(acc, 2));
+        count += _mm_extract_epi16(acc, 0);
+
+        for (; k < len; k++)
+            if ((src[k] >= thres) && (src[k - 1] < thres)) count++;
+
+        return count;
+    }
+
 private:
     IppiSize srcSize;
     float* scoeff;
@@ -162,6 +321,8 @@ private:
 
 public:
     bool initiated;
+    std::atomic<bool> windows_changed; // set by the UI thread (edited channel windows)
+    bool template_changed;
 
     MKL_INT nx, ny; // original data length, dimension
     MKL_INT nsite; // interpolated data length
@@ -179,6 +340,12 @@ public:
     FloatArray2 ext_src;
 
 	FloatArray2 intensity;
+    FloatArray2 unmixed;
+    FloatArray2 prefix;
+    FloatArray2 delay;
+
+    FloatArray match_kernel;
+    FloatArray ramp;
 
 	callback<const char*> SendStatusMessage;
 };
@@ -197,10 +364,26 @@ private: // Not to call copy constrcutor and copy assignment operator
 	
 public:
     // Generate fluorescence intensity & lifetime
-    void operator()(FloatArray2& intensity, Uint16Array2& pulse);
+    // (aline_offset >= 0: cache the prefix sums at that position of an image of image_alines A-lines)
+    // (lifetime: intensity-weighted mean delay, tau * intensity, for the intensity-weighted lifetime rendering)
+    void operator()(FloatArray2& intensity, Uint16Array2& pulse, int aline_offset = -1, int image_alines = 0, FloatArray2* lifetime = nullptr);
 
     // For FLIM parameters setting
     void setParameters(Configuration* pConfig);
+
+    // Matched filter pulse template (averaged pulse of the next processed chunk, saved to filename)
+    // (requests from the UI thread are staged, and applied by the processing thread between chunks)
+    void capturePulseTemplate(const char* filename);
+    bool loadPulseTemplate(const char* filename);
+    bool savePulseTemplate(const char* filename);
+
+    // Spectral crosstalk unmixing (inverse of the calibrated crosstalk matrix, staged with the on/off flag like the template)
+    bool setUnmixing(const float* crosstalk, bool enabled);
+
+    // Re-render boxcar channel intensities of the last image from the cached prefix sums
+    // (prefix sums are only built & cached while editing is enabled, i.e. the calibration dialog is open)
+    void setEditingEnabled(bool enabled);
+    bool getCachedIntensity(FloatArray2& image, bool* channels);
 	
 // Variables
 public:
@@ -208,6 +391,27 @@ public:
 
     OPERATOR _operator; // resize objects
 
+private:
+    void applyStagedParameters();
+    void captureStagedTemplate();
+
+private:
+    // Staged by the UI thread, swapped in on the processing thread
+    std::mutex _staged_mtx;
+    FloatArray _staged_template;
+    std::atomic<bool> _template_staged;
+    float _staged_unmix[16];
+    bool _staged_unmixing;
+    std::atomic<bool> _unmix_staged;
+    std::atomic<bool> _capture_requested;
+    QString _capture_filename;
+
+    // Prefix sums of the most recent image (nx + 1, image A-lines)
+    std::atomic<bool> _editing;
+    FloatArray2 _prefix_cache;
+    bool _prefix_filling, _prefix_valid;
+    std::mutex _prefix_mtx;
+
 public:
 	// Callbacks
 	callback<const char*> SendStatusMessage;
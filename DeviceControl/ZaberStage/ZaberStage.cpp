@@ -15,6 +15,8 @@ ZaberStage::ZaberStage() :
     _running(false),
     cur_dev(1),
     comm_num(1),
+    motion_num(-1),
+    pos_num(-1),
     is_moving(false)
 {
 	m_pSerialComm = new QSerialComm;
@@ -53,7 +55,7 @@ bool ZaberStage::ConnectDevice()
                     {
                         msg[j] = '\0';
                         SendStatusMessage(msg, false);
-                        if (is_moving) DidMovedRelative(msg);
+                        if (is_moving && isMotionReply(msg)) DidMovedRelative(msg);
                         j = 0;
                     }
 
@@ -129,6 +131,8 @@ void ZaberStage::Home(int _stageNumber)
     sprintf(msg, "ZABER: Send: %s", buff);
     SendStatusMessage(msg, false);
 
+    motion_num = comm_num;
+    pos_num = -1; // position polls of the previous move
     comm_num++;
     if (comm_num == 96) comm_num = 1;
 
@@ -168,6 +172,8 @@ void ZaberStage::MoveAbsolute(int _stageNumber, double position)
     sprintf(msg, "ZABER: Send: %s", buff);
     SendStatusMessage(msg, false);
 
+    motion_num = comm_num;
+    pos_num = -1;
     comm_num++;
     if (comm_num == 96) comm_num = 1;
 
@@ -189,6 +195,8 @@ void ZaberStage::MoveRelative(int _stageNumber, double position)
     sprintf(msg, "ZABER: Send: %s", buff);
     SendStatusMessage(msg, false);
 
+    motion_num = comm_num;
+    pos_num = -1;
     comm_num++;
     if (comm_num == 96) comm_num = 1;
 
@@ -226,8 +234,21 @@ void ZaberStage::GetPos()
     sprintf(msg, "ZABER: Send: %s", buff);
     SendStatusMessage(msg, false);
 
+    pos_num = comm_num;
     comm_num++;
     if (comm_num == 96) comm_num = 1;
 
     m_pSerialComm->writeSerialPort(buff);
 }
+
+
+bool ZaberStage::isMotionReply(const char* reply)
+{
+    // Reply: "@dd a mm OK IDLE|BUSY ...", only the replies of the motion commands tell the end of a move
+    // (e.g. the reply of a set maxspeed sent during a move is also IDLE)
+    int dev, axis, id;
+    if (sscanf(reply, "@%d %d %d", &dev, &axis, &id) != 3)
+        return false;
+
+    return (id == motion_num) || (id == pos_num);
+}
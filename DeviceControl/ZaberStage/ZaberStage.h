@@ -37,6 +37,9 @@ public:
     callback<void> DidMonitoring;
     callback2<const char*, bool> SendStatusMessage;
 
+private:
+    bool isMotionReply(const char* reply);
+
 private:
 	QSerialComm* m_pSerialComm;
 	const char* port_name;
@@ -49,6 +52,7 @@ private:
 
     int cur_dev;
     int comm_num;
+    int motion_num, pos_num; // message ids of the last move/home & get pos (replied with the motion status)
     bool is_moving;
 };
 
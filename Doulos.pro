@@ -55,7 +55,9 @@ SOURCES += Doulos/Doulos.cpp \
     Doulos/QVisualizationTab.cpp \
     Doulos/Viewer/QScope.cpp \
     Doulos/Viewer/QImageView.cpp \
-    Doulos/Dialog/PulseCalibDlg.cpp
+    Doulos/Viewer/QTileView.cpp \
+    Doulos/Dialog/PulseCalibDlg.cpp \
+    Doulos/Dialog/HistogramDlg.cpp
 
 SOURCES += DataAcquisition/SignatecDAQ/SignatecDAQ.cpp \
     DataAcquisition/DataProcess/DataProcess.cpp \
@@ -79,7 +81,9 @@ HEADERS += Doulos/Configuration.h \
     Doulos/QVisualizationTab.h \
     Doulos/Viewer/QScope.h \
     Doulos/Viewer/QImageView.h \
-    Doulos/Dialog/PulseCalibDlg.h
+    Doulos/Viewer/QTileView.h \
+    Doulos/Dialog/PulseCalibDlg.h \
+    Doulos/Dialog/HistogramDlg.h
 
 HEADERS += DataAcquisition/SignatecDAQ/SignatecDAQ.h \
     DataAcquisition/DataProcess/DataProcess.h \
@@ -95,5 +99,17 @@ HEADERS += DeviceControl/PmtGain/PmtGainControl.h \
     DeviceControl/ZaberStage/ZaberStage.h \
     DeviceControl/QSerialComm.h
 
+HEADERS += Common/FlatField.h \
+    Common/ImageRender.h \
+    Common/TripleBuffer.h \
+    Common/Histogram.h \
+    Common/RunningAverage.h \
+    Common/ScanCompensation.h \
+    Common/PulseMonitor.h \
+    Common/RoiStats.h \
+    Common/FocusMetric.h \
+    Common/TilePyramid.h \
+    Common/ColorLut.h
+
 
 FORMS   += Doulos/MainWindow.ui
@@ -37,6 +37,7 @@
 #define ZABER_PORT					"COM5"
 #define ZABER_MICRO_STEPSIZE		0.047625 // micro-meter ///
 #define ZABER_CONVERSION_FACTOR		1.6384
+#define ZABER_FOCUS_AXIS			3 // device number of the focus (z) axis
 
 //////////////// Thread & Buffer Processing /////////////////
 #define RAW_PULSE_WRITE
@@ -56,8 +57,6 @@
 #define CARS_COLORTABLE			    ColorTable::redo
 #define RCM_COLORTABLE			    ColorTable::gray
 
-//#define MED_FILT
-
 #define RENEWAL_COUNT				20 //20
 
 
@@ -78,7 +77,7 @@ struct Range
 class Configuration
 {
 public:
-    explicit Configuration() : imageAccumulationFrames(1), imageAveragingFrames(1), resonantScanVoltage(0), crsCompensation(false) {}
+    explicit Configuration() : imageAccumulationFrames(1), imageAveragingFrames(1), imageAveragingMode(0), resonantScanVoltage(0), crsCompensation(false), crossTalkUnmixing(false), flatFieldCorrection(false), flatFieldFrames(16), autoContrast(false), autoContrastLow(1.0f), autoContrastHigh(99.5f), autoContrastSmoothing(0.2f), medianFilterSize(0), displayRate(60), lifetimeRendering(false), focusMetric(false), focusMetricMode(0), autofocusRange(0.1f), autofocusSpeed(0.05f), autofocusChannel(0), mosaicCacheSize(256) {}
 	~Configuration() {}
 
 public:
@@ -101,6 +100,7 @@ public:
 		// Image averaging & accumulation
 		imageAccumulationFrames = settings.value("imageAccumulationFrames").toInt();
 		imageAveragingFrames = settings.value("imageAveragingFrames").toInt();
+		imageAveragingMode = settings.value("imageAveragingMode").toInt();
 
         // Image stitching
         imageStichingXStep = settings.value("imageStichingXStep").toInt();
@@ -114,6 +114,9 @@ public:
 		flimWidthFactor = settings.value("flimWidthFactor").toFloat();
         for (int i = 0; i < 5; i++)
 			flimChStartInd[i] = settings.value(QString("flimChStartInd_%1").arg(i)).toInt();
+        for (int i = 0; i < 4; i++)
+            channelIntensityMode[i] = settings.value(QString("channelIntensityMode_%1").arg(i)).toInt();
+        photonCountThres = settings.value("photonCountThres", 1000.0f).toFloat();
 
         // Image contrast & processing
         for (int i = 0; i < 4; i++)
@@ -121,7 +124,30 @@ public:
             imageContrastRange[i].max = settings.value(QString("imageContrastRangeMax_%1").arg(i)).toFloat();
             imageContrastRange[i].min = settings.value(QString("imageContrastRangeMin_%1").arg(i)).toFloat();
         }
+        autoContrast = settings.value("autoContrast").toBool();
+        autoContrastLow = settings.value("autoContrastLow", 1.0f).toFloat();
+        autoContrastHigh = settings.value("autoContrastHigh", 99.5f).toFloat();
+        autoContrastSmoothing = settings.value("autoContrastSmoothing", 0.2f).toFloat();
+        for (int i = 0; i < 4; i++)
+            saturationLevel[i] = settings.value(QString("saturationLevel_%1").arg(i), 0.0f).toFloat();
         crsCompensation = settings.value("crsCompensation").toBool();
+        for (int i = 0; i < 16; i++)
+            crossTalkMatrix[i] = settings.value(QString("crossTalkMatrix_%1").arg(i), (i % 5 == 0) ? 1.0f : 0.0f).toFloat();
+        crossTalkUnmixing = settings.value("crossTalkUnmixing").toBool();
+        flatFieldCorrection = settings.value("flatFieldCorrection").toBool();
+        flatFieldFrames = settings.value("flatFieldFrames", 16).toInt();
+
+        // Display
+        medianFilterSize = settings.value("medianFilterSize", 0).toInt();
+        displayRate = settings.value("displayRate", 60).toInt();
+        lifetimeRendering = settings.value("lifetimeRendering").toBool();
+        lifetimeRange.min = settings.value("lifetimeRangeMin", 1.0f).toFloat();
+        lifetimeRange.max = settings.value("lifetimeRangeMax", 6.0f).toFloat();
+        focusMetric = settings.value("focusMetric").toBool();
+        focusMetricMode = settings.value("focusMetricMode", 0).toInt();
+        for (int i = 0; i < 4; i++)
+            clippingOverlay[i] = settings.value(QString("clippingOverlay_%1").arg(i)).toBool();
+        mosaicCacheSize = settings.value("mosaicCacheSize", 256).toInt();
 
 		// Device control
         pmtGainVoltage = settings.value("pmtGainVoltage").toFloat();
@@ -132,6 +158,9 @@ public:
         galvoScanVoltageOffset = settings.value("galvoScanVoltageOffset").toFloat();
         zaberPullbackSpeed = settings.value("zaberPullbackSpeed").toFloat();
         zaberPullbackLength = settings.value("zaberPullbackLength").toFloat();
+        autofocusRange = settings.value("autofocusRange", 0.1f).toFloat();
+        autofocusSpeed = settings.value("autofocusSpeed", 0.05f).toFloat();
+        autofocusChannel = settings.value("autofocusChannel", 0).toInt();
         
 		settings.endGroup();
 	}
@@ -155,6 +184,7 @@ public:
 		// Image averaging & accumulation
 		settings.setValue("imageAccumulationFrames", imageAccumulationFrames);
 		settings.setValue("imageAveragingFrames", imageAveragingFrames);
+		settings.setValue("imageAveragingMode", imageAveragingMode);
 
         // Image stitching
         settings.setValue("imageStichingXStep", imageStichingXStep);
@@ -168,6 +198,9 @@ public:
 		settings.setValue("flimWidthFactor", QString::number(flimWidthFactor, 'f', 2)); 
         for (int i = 0; i < 5; i++)
 			settings.setValue(QString("flimChStartInd_%1").arg(i), flimChStartInd[i]);
+        for (int i = 0; i < 4; i++)
+            settings.setValue(QString("channelIntensityMode_%1").arg(i), channelIntensityMode[i]);
+        settings.setValue("photonCountThres", QString::number(photonCountThres, 'f', 1));
 
         // Image contrast & processing
         for (int i = 0; i < 4; i++)
@@ -175,7 +208,30 @@ public:
             settings.setValue(QString("imageContrastRangeMax_%1").arg(i), QString::number(imageContrastRange[i].max, 'f', 1));
             settings.setValue(QString("imageContrastRangeMin_%1").arg(i), QString::number(imageContrastRange[i].min, 'f', 1));
         }
+        settings.setValue("autoContrast", autoContrast);
+        settings.setValue("autoContrastLow", QString::number(autoContrastLow, 'f', 1));
+        settings.setValue("autoContrastHigh", QString::number(autoContrastHigh, 'f', 1));
+        settings.setValue("autoContrastSmoothing", QString::number(autoContrastSmoothing, 'f', 2));
+        for (int i = 0; i < 4; i++)
+            settings.setValue(QString("saturationLevel_%1").arg(i), QString::number(saturationLevel[i], 'f', 1));
         settings.setValue("crsCompensation", crsCompensation);
+        for (int i = 0; i < 16; i++)
+            settings.setValue(QString("crossTalkMatrix_%1").arg(i), QString::number(crossTalkMatrix[i], 'f', 4));
+        settings.setValue("crossTalkUnmixing", crossTalkUnmixing);
+        settings.setValue("flatFieldCorrection", flatFieldCorrection);
+        settings.setValue("flatFieldFrames", flatFieldFrames);
+
+        // Display
+        settings.setValue("medianFilterSize", medianFilterSize);
+        settings.setValue("displayRate", displayRate);
+        settings.setValue("lifetimeRendering", lifetimeRendering);
+        settings.setValue("lifetimeRangeMin", QString::number(lifetimeRange.min, 'f', 2));
+        settings.setValue("lifetimeRangeMax", QString::number(lifetimeRange.max, 'f', 2));
+        settings.setValue("focusMetric", focusMetric);
+        settings.setValue("focusMetricMode", focusMetricMode);
+        for (int i = 0; i < 4; i++)
+            settings.setValue(QString("clippingOverlay_%1").arg(i), clippingOverlay[i]);
+        settings.setValue("mosaicCacheSize", mosaicCacheSize);
 
 		// Device control
         settings.setValue("pmtGainVoltage", QString::number(pmtGainVoltage, 'f', 2));
@@ -187,6 +243,9 @@ public:
 		settings.setValue("resonantScanVoltage", QString::number(resonantScanVoltage, 'f', 1));        
         settings.setValue("zaberPullbackSpeed", QString::number(zaberPullbackSpeed, 'f', 2));
         settings.setValue("zaberPullbackLength", QString::number(zaberPullbackLength, 'f', 2));
+        settings.setValue("autofocusRange", QString::number(autofocusRange, 'f', 3));
+        settings.setValue("autofocusSpeed", QString::number(autofocusSpeed, 'f', 3));
+        settings.setValue("autofocusChannel", autofocusChannel);
 
 		// Current Time
 		QDate date = QDate::currentDate();
@@ -210,6 +269,7 @@ public:
 	// Image averaging & accumulation
 	int imageAccumulationFrames;
 	int imageAveragingFrames;
+	int imageAveragingMode; // block, exponential or sliding window
 
     // Image stitching
     int imageStichingXStep;
@@ -221,10 +281,30 @@ public:
 	float flimBg;
 	float flimWidthFactor;
     int flimChStartInd[5];
+    int channelIntensityMode[4];
+    float photonCountThres;
 
     // Image contrast & processing
     Range<float> imageContrastRange[4];
+    bool autoContrast;
+    float autoContrastLow, autoContrastHigh; // percentiles (%)
+    float autoContrastSmoothing; // exponential smoothing factor per frame
+    float saturationLevel[4]; // image units (0: not monitored)
     bool crsCompensation;
+    float crossTalkMatrix[16]; // row-major, observed = M * true
+    bool crossTalkUnmixing;
+    bool flatFieldCorrection;
+    int flatFieldFrames;
+
+    // Display
+    int medianFilterSize; // 0 (off), 3 or 5
+    int displayRate; // Hz (rendering cap, averaging & recording use every frame)
+    bool lifetimeRendering; // mean delay (hue) & intensity (brightness)
+    Range<float> lifetimeRange; // nsec
+    bool focusMetric; // live sharpness of each channel
+    int focusMetricMode; // FOCUS_LAPLACIAN or FOCUS_GRADIENT
+    bool clippingOverlay[4]; // clipped & saturated pixels in overlay colors
+    int mosaicCacheSize; // MB (decoded tiles of the mosaic viewer)
 
 	// Device control
     float pmtGainVoltage; 
@@ -238,6 +318,9 @@ public:
 
     float zaberPullbackSpeed;
     float zaberPullbackLength;
+    float autofocusRange; // mm (sweep centered at the current position)
+    float autofocusSpeed; // mm/s
+    int autofocusChannel;
 	
 	// Message callback
 	callback<const char*> msgHandle;
@@ -0,0 +1,148 @@
+
+#include "HistogramDlg.h"
+
+#include <Doulos/MainWindow.h>
+#include <Doulos/QStreamTab.h>
+#include <Doulos/QVisualizationTab.h>
+
+#include <iostream>
+#include <cmath>
+
+
+static const QColor channel_color[4] = { QColor(0x4daf4a), QColor(0xe41a1c), QColor(0xff7f00), QColor(0xf0f0f0) };
+
+HistogramDlg::HistogramDlg(QWidget *parent) : QDialog(parent)
+{
+	// Set default size & frame
+	setFixedSize(600, 640);
+	setWindowFlags(Qt::Tool);
+	setWindowTitle("Histogram");
+
+	// Set main window objects
+	m_pVisualizationTab = dynamic_cast<QVisualizationTab*>(parent);
+	m_pConfig = m_pVisualizationTab->getStreamTab()->getMainWnd()->m_pConfiguration;
+	m_pHistogram = &m_pVisualizationTab->getStreamTab()->m_histogram;
+
+	m_bins = np::Array<int, 2>(HISTOGRAM_BINS, 4);
+	m_logCounts = np::FloatArray(HISTOGRAM_BINS);
+
+
+	// Create layout
+	m_pVBoxLayout = new QVBoxLayout;
+	m_pVBoxLayout->setSpacing(3);
+
+	// Create widgets for histogram view
+	createHistogramViews();
+
+	// Set layout
+	this->setLayout(m_pVBoxLayout);
+
+	// Histograms are built in the averaging pass while the viewer is open
+	m_pHistogram->setEnabled(true);
+
+	m_pTimer_Monitor = new QTimer(this);
+	m_pTimer_Monitor->start(1000 / qMax(m_pConfig->displayRate, 1));
+	connect(m_pTimer_Monitor, SIGNAL(timeout()), this, SLOT(drawHistograms()));
+}
+
+HistogramDlg::~HistogramDlg()
+{
+	m_pHistogram->setEnabled(false);
+}
+
+void HistogramDlg::keyPressEvent(QKeyEvent *e)
+{
+	if (e->key() != Qt::Key_Escape)
+		QDialog::keyPressEvent(e);
+}
+
+
+void HistogramDlg::createHistogramViews()
+{
+	// Counts in log scale (up to the pixels of an image)
+	double max_count = log10((double)m_pConfig->nPixels * (double)(m_pConfig->nLines - GALVO_FLYING_BACK) + 1.0);
+
+	for (int i = 0; i < 4; i++)
+	{
+		// Create widgets for histogram view
+		m_pScope_Histogram[i] = new QScope({ 0, (double)HISTOGRAM_BINS }, { 0, ceil(max_count) },
+			2, 2, 1.0 / (double)HISTOGRAM_BINS, 1, 0, 0, "", "", false);
+		m_pScope_Histogram[i]->setMinimumHeight(110);
+		m_pScope_Histogram[i]->getRender()->setGrid(8, 32, 1);
+		m_pScope_Histogram[i]->setTraceColor(0, channel_color[i]);
+
+		m_pLabel_Clipping[i] = new QLabel(this);
+		m_pLabel_Clipping[i]->setText(QString("Ch %1").arg(i + 1));
+
+		m_pLineEdit_SaturationLevel[i] = new QLineEdit(this);
+		m_pLineEdit_SaturationLevel[i]->setFixedWidth(50);
+		m_pLineEdit_SaturationLevel[i]->setText(QString::number(m_pConfig->saturationLevel[i], 'f', 1));
+		m_pLineEdit_SaturationLevel[i]->setAlignment(Qt::AlignCenter);
+		m_pLineEdit_SaturationLevel[i]->setToolTip("Saturation level (0: not monitored)");
+		m_pLabel_SaturationLevel[i] = new QLabel("Saturation", this);
+		m_pLabel_SaturationLevel[i]->setBuddy(m_pLineEdit_SaturationLevel[i]);
+
+		// Set layout
+		QHBoxLayout *pHBoxLayout_Clipping = new QHBoxLayout;
+		pHBoxLayout_Clipping->setSpacing(3);
+
+		pHBoxLayout_Clipping->addWidget(m_pLabel_Clipping[i]);
+		pHBoxLayout_Clipping->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed));
+		pHBoxLayout_Clipping->addWidget(m_pLabel_SaturationLevel[i]);
+		pHBoxLayout_Clipping->addWidget(m_pLineEdit_SaturationLevel[i]);
+
+		m_pVBoxLayout->addWidget(m_pScope_Histogram[i]);
+		m_pVBoxLayout->addItem(pHBoxLayout_Clipping);
+
+		// Connect
+		connect(m_pLineEdit_SaturationLevel[i], SIGNAL(textChanged(const QString &)), this, SLOT(changeSaturationLevel(const QString &)));
+	}
+}
+
+
+void HistogramDlg::drawHistograms()
+{
+	for (int i = 0; i < 4; i++)
+	{
+		float lo, hi;
+		HistogramClipping clipping;
+		int* pBins = &m_bins(0, i);
+		if (!m_pHistogram->fetch(i, pBins, lo, hi, clipping))
+			continue;
+
+		// Bin range of the frame (x axis in image units)
+		float width = (hi - lo) / (float)HISTOGRAM_BINS;
+		for (int j = 0; j < HISTOGRAM_BINS; j++)
+			m_logCounts[j] = log10f((float)pBins[j] + 1.0f);
+
+		QRange y_range = { 0, m_pScope_Histogram[i]->getRender()->m_yRange.max };
+		m_pScope_Histogram[i]->resetAxis({ 0, (double)HISTOGRAM_BINS }, y_range, width, 1, lo, 0);
+
+		// Contrast range (& saturation level) as bin positions
+		auto bin = [&](float v) { return (width > 0) ? (int)((v - lo) / width) : 0; };
+		float sat = m_pConfig->saturationLevel[i];
+		if (sat > 0)
+			m_pScope_Histogram[i]->setWindowLine(3, bin(m_pConfig->imageContrastRange[i].min), bin(m_pConfig->imageContrastRange[i].max), bin(sat));
+		else
+			m_pScope_Histogram[i]->setWindowLine(2, bin(m_pConfig->imageContrastRange[i].min), bin(m_pConfig->imageContrastRange[i].max));
+
+		m_pScope_Histogram[i]->drawData(0, m_logCounts.raw_ptr(), HISTOGRAM_BINS);
+
+		// Fractions of the clipped & saturated pixels
+		QString str = QString("Ch %1    clipped low: %2 %   high: %3 %")
+			.arg(i + 1).arg(100.0f * clipping.under, 0, 'f', 2).arg(100.0f * clipping.over, 0, 'f', 2);
+		if (sat > 0)
+			str += QString("   saturated: %1 %").arg(100.0f * clipping.saturated, 0, 'f', 2);
+		m_pLabel_Clipping[i]->setText(str);
+	}
+}
+
+void HistogramDlg::changeSaturationLevel(const QString &)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		float level = m_pLineEdit_SaturationLevel[i]->text().toFloat();
+		if (level >= 0)
+			m_pConfig->saturationLevel[i] = level;
+	}
+}
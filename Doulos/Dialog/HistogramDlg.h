@@ -0,0 +1,59 @@
+#ifndef HISTOGRAMDLG_H
+#define HISTOGRAMDLG_H
+
+#include <QObject>
+#include <QtWidgets>
+#include <QtCore>
+
+#include <Doulos/Configuration.h>
+#include <Doulos/Viewer/QScope.h>
+
+#include <Common/array.h>
+#include <Common/Histogram.h>
+
+class QVisualizationTab;
+
+
+class HistogramDlg : public QDialog
+{
+	Q_OBJECT
+
+// Constructer & Destructer /////////////////////////////
+public:
+	explicit HistogramDlg(QWidget *parent = nullptr);
+	virtual ~HistogramDlg();
+
+// Methods //////////////////////////////////////////////
+private:
+	void keyPressEvent(QKeyEvent *e);
+
+private:
+	void createHistogramViews();
+
+public slots : // widgets
+	void drawHistograms();
+	void changeSaturationLevel(const QString &);
+
+	// Variables ////////////////////////////////////////////
+private:
+	Configuration* m_pConfig;
+	QVisualizationTab* m_pVisualizationTab;
+	Histogram* m_pHistogram;
+
+	// Histograms of the formed images (fetched at display rate)
+	QTimer *m_pTimer_Monitor;
+	np::Array<int, 2> m_bins; // (HISTOGRAM_BINS, 4)
+	np::FloatArray m_logCounts;
+
+private:
+	// Layout
+	QVBoxLayout *m_pVBoxLayout;
+
+	// Widgets for histogram view
+	QScope *m_pScope_Histogram[4];
+	QLabel *m_pLabel_Clipping[4];
+	QLineEdit *m_pLineEdit_SaturationLevel[4];
+	QLabel *m_pLabel_SaturationLevel[4];
+};
+
+#endif // HISTOGRAMDLG_H
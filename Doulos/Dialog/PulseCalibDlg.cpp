@@ -3,6 +3,7 @@
 
 #include <Doulos/MainWindow.h>
 #include <Doulos/QStreamTab.h>
+#include <Doulos/QVisualizationTab.h>
 #include <Doulos/QDeviceControlTab.h>
 #include <Doulos/QOperationTab.h>
 
@@ -16,7 +17,7 @@
 PulseCalibDlg::PulseCalibDlg(QWidget *parent) : QDialog(parent)
 {
 	// Set default size & frame
-    setFixedSize(600, 550);
+    setFixedSize(600, 575);
 	setWindowFlags(Qt::Tool);
 	setWindowTitle("Pulse Calibration");
 
@@ -24,6 +25,17 @@ PulseCalibDlg::PulseCalibDlg(QWidget *parent) : QDialog(parent)
 	m_pDeviceControlTab = dynamic_cast<QDeviceControlTab*>(parent);
 	m_pConfig = m_pDeviceControlTab->getStreamTab()->getMainWnd()->m_pConfiguration;
 	m_pDataProc = m_pDeviceControlTab->getStreamTab()->getOperationTab()->getDataAcq()->getDataProc();
+	m_pPulseMonitor = &m_pDeviceControlTab->getStreamTab()->m_pulseMonitor;
+
+	m_pulseMean = np::FloatArray(m_pConfig->nScans);
+	m_pulseMin = np::FloatArray(m_pConfig->nScans);
+	m_pulseMax = np::FloatArray(m_pConfig->nScans);
+	m_pulseImage = np::Uint8Array2(m_pConfig->nScans, m_pConfig->nPixels);
+	memset(m_pulseMean.raw_ptr(), 0, sizeof(float) * m_pulseMean.length());
+	memset(m_pulseMin.raw_ptr(), 0, sizeof(float) * m_pulseMin.length());
+	memset(m_pulseMax.raw_ptr(), 0, sizeof(float) * m_pulseMax.length());
+	memset(m_pulseImage.raw_ptr(), 0, sizeof(uint8_t) * m_pulseImage.length());
+	m_bPulseFetched = false;
 
 
 	// Create layout
@@ -37,11 +49,19 @@ PulseCalibDlg::PulseCalibDlg(QWidget *parent) : QDialog(parent)
 	// Set layout
 	this->setLayout(m_pVBoxLayout);
 
-	drawRoiPulse(m_pDataProc, 0);
+	// Pulse monitor & channel window editing (prefix sums for re-rendering)
+	m_pPulseMonitor->setEnabled(true);
+	m_pDataProc->setEditingEnabled(true);
+
+	m_pTimer_Monitor = new QTimer(this);
+	m_pTimer_Monitor->start(1000 / qMax(m_pConfig->displayRate, 1));
+	connect(m_pTimer_Monitor, SIGNAL(timeout()), this, SLOT(drawRoiPulse()));
 }
 
 PulseCalibDlg::~PulseCalibDlg()
 {
+	m_pPulseMonitor->setEnabled(false);
+	m_pDataProc->setEditingEnabled(false);
 }
 
 void PulseCalibDlg::keyPressEvent(QKeyEvent *e)
@@ -68,6 +88,7 @@ void PulseCalibDlg::createPulseView()
 	m_pScope_PulseView->setMinimumHeight(180);
 	m_pScope_PulseView->getRender()->setGrid(8, 32, 1, true);
 	m_pScope_PulseView->setDcLine(m_pDataProc->_params.bg);	
+	m_pScope_PulseView->setTraces(3); // mean & min/max envelope
 
     QLabel *pLabel_null = new QLabel(this);
     pLabel_null->setFixedWidth(37);
@@ -92,8 +113,6 @@ void PulseCalibDlg::createPulseView()
 	m_pVBoxLayout->addItem(pGridLayout_PulseView);
 
 	// Connect
-	connect(this, SIGNAL(plotRoiPulse(DataProcess*, int)), this, SLOT(drawRoiPulse(DataProcess*, int)));
-
 	connect(m_pCheckBox_ShowWindow, SIGNAL(toggled(bool)), this, SLOT(showWindow(bool)));
 	connect(m_pCheckBox_SplineView, SIGNAL(toggled(bool)), this, SLOT(splineView(bool)));
 }
@@ -149,6 +168,29 @@ void PulseCalibDlg::createCalibWidgets()
 	m_pLabel_NanoSec = new QLabel("nsec", this);
 	m_pLabel_NanoSec->setFixedWidth(25);
 
+	m_pPushButton_CaptureTemplate = new QPushButton(this);
+	m_pPushButton_CaptureTemplate->setText("Capture Template");
+
+	m_pLabel_IntensityMode = new QLabel("Intensity Mode  ", this);
+
+	for (int i = 0; i < 4; i++)
+	{
+		m_pComboBox_IntensityMode[i] = new QComboBox(this);
+		m_pComboBox_IntensityMode[i]->addItem("Boxcar");
+		m_pComboBox_IntensityMode[i]->addItem("Matched");
+		m_pComboBox_IntensityMode[i]->addItem("Photon");
+		m_pComboBox_IntensityMode[i]->setFixedWidth(70);
+		m_pComboBox_IntensityMode[i]->setCurrentIndex(m_pDataProc->_params.intensity_mode[i]);
+	}
+
+	m_pLineEdit_PhotonThres = new QLineEdit(this);
+	m_pLineEdit_PhotonThres->setText(QString::number(m_pDataProc->_params.photon_thres, 'f', 1));
+	m_pLineEdit_PhotonThres->setFixedWidth(70);
+	m_pLineEdit_PhotonThres->setAlignment(Qt::AlignCenter);
+	m_pLineEdit_PhotonThres->setToolTip("Photon counting threshold above background");
+	m_pLabel_PhotonThres = new QLabel("thres", this);
+	m_pLabel_PhotonThres->setFixedWidth(25);
+
 	// Set layout
 	QHBoxLayout *pHBoxLayout_Background = new QHBoxLayout;
 	pHBoxLayout_Background->setSpacing(2);
@@ -157,6 +199,7 @@ void PulseCalibDlg::createCalibWidgets()
 	pHBoxLayout_Background->addWidget(m_pCheckBox_ShowWindow);
 	pHBoxLayout_Background->addWidget(m_pCheckBox_SplineView);
 	pHBoxLayout_Background->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed));
+	pHBoxLayout_Background->addWidget(m_pPushButton_CaptureTemplate);
 	pHBoxLayout_Background->addWidget(m_pPushButton_CaptureBackground);
 	pHBoxLayout_Background->addWidget(m_pLineEdit_Background);
 
@@ -176,6 +219,12 @@ void PulseCalibDlg::createCalibWidgets()
 	}
     pGridLayout_ChStart->addWidget(m_pLabel_NanoSec, 1, 7);
 
+	pGridLayout_ChStart->addWidget(m_pLabel_IntensityMode, 2, 1);
+	for (int i = 0; i < 4; i++)
+		pGridLayout_ChStart->addWidget(m_pComboBox_IntensityMode[i], 2, i + 2);
+	pGridLayout_ChStart->addWidget(m_pLineEdit_PhotonThres, 2, 6);
+	pGridLayout_ChStart->addWidget(m_pLabel_PhotonThres, 2, 7);
+
     pGridLayout_PulseView->addItem(pGridLayout_ChStart, 1, 0, 1, 9);
 
 	m_pVBoxLayout->addItem(pGridLayout_PulseView);
@@ -188,37 +237,34 @@ void PulseCalibDlg::createCalibWidgets()
 	connect(m_pSpinBox_ChStart[2], SIGNAL(valueChanged(double)), this, SLOT(resetChStart2(double)));
 	connect(m_pSpinBox_ChStart[3], SIGNAL(valueChanged(double)), this, SLOT(resetChStart3(double)));
     connect(m_pSpinBox_ChStart[4], SIGNAL(valueChanged(double)), this, SLOT(resetChStart4(double)));
+    for (int i = 0; i < 5; i++)
+        connect(m_pSpinBox_ChStart[i], SIGNAL(valueChanged(double)), this, SLOT(reformImage()));
+	connect(m_pPushButton_CaptureTemplate, SIGNAL(clicked(bool)), this, SLOT(captureTemplate()));
+	for (int i = 0; i < 4; i++)
+		connect(m_pComboBox_IntensityMode[i], SIGNAL(currentIndexChanged(int)), this, SLOT(changeIntensityMode(int)));
+	connect(m_pLineEdit_PhotonThres, SIGNAL(textChanged(const QString &)), this, SLOT(changePhotonThreshold(const QString &)));
 }
 			
 
-void PulseCalibDlg::drawRoiPulse(DataProcess* pFLIm, int aline)
+void PulseCalibDlg::drawRoiPulse()
 {
-	// Reset pulse view (if necessary)
-//	static int roi_width = 0;
-	np::FloatArray2 data0((!m_pCheckBox_SplineView->isChecked()) ? pFLIm->_operator.crop_src0 : pFLIm->_operator.ext_src);
-	np::FloatArray2 data(data0.size(0), data0.size(1));
-	memcpy(data.raw_ptr(), data0.raw_ptr(), sizeof(float) * data0.length());
-
-//	if (roi_width != data.size(0))
-//	{
-//		float factor = (!m_pCheckBox_SplineView->isChecked()) ? 1 : pFLIm->_operator.upSampleFactor;
-
-//		//m_pScope_PulseView->getRender()->m_bMaskUse = true;
-//		m_pScope_PulseView->resetAxis({ 0, (double)data.size(0) }, { 0, POWER_2(16) },
-//			pFLIm->_params.samp_intv / factor, PX14_VOLT_RANGE / (double)POWER_2(16), 0, 0, " nsec", " V");
-//		roi_width = data.size(0);
-//	}
-
-    // ROI image
-    np::Uint8Array2 pulse_image(data.size(0), data.size(1));
-    ippiScale_32f8u_C1R(data.raw_ptr(), sizeof(float) * data.size(0),
-                        pulse_image.raw_ptr(), sizeof(uint8_t) * pulse_image.size(0),
-                        {data.size(0), data.size(1)}, 0, 65535);
-    m_pImageView_PulseImage->drawImage(pulse_image.raw_ptr());
-
-	// ROI pulse
-	ippsAddC_32f_I(pFLIm->_params.bg, data.raw_ptr(), data.length());
-	m_pScope_PulseView->drawData(&data(0, aline));
+	// Selected A-line (follows the pixel position of the image views)
+	int x, y;
+	m_pDeviceControlTab->getStreamTab()->getVisualizationTab()->getPixelPos(&x, &y);
+	m_pPulseMonitor->select(y, x);
+
+	if (!m_pPulseMonitor->fetch(m_pulseMean.raw_ptr(), m_pulseMin.raw_ptr(), m_pulseMax.raw_ptr(), m_pulseImage.raw_ptr()))
+		return;
+	m_bPulseFetched = true;
+
+	// Pulses of the selected line
+	m_pImageView_PulseImage->setHorizontalLine(1, x);
+	m_pImageView_PulseImage->drawImage(m_pulseImage.raw_ptr());
+
+	// Rolling mean pulse & envelope of the selected A-line
+	m_pScope_PulseView->drawData(1, m_pulseMin.raw_ptr(), m_pulseMin.length());
+	m_pScope_PulseView->drawData(2, m_pulseMax.raw_ptr(), m_pulseMax.length());
+	m_pScope_PulseView->drawData(0, m_pulseMean.raw_ptr(), m_pulseMean.length());
 }
 
 void PulseCalibDlg::showWindow(bool checked)
@@ -256,14 +302,17 @@ void PulseCalibDlg::splineView(bool checked)
 	}
 
     m_pImageView_PulseImage->getRender()->update();
-	drawRoiPulse(m_pDataProc, 0);
 }
 
 
 void PulseCalibDlg::captureBackground()
 {
+	// No pulse fetched yet (e.g. acquisition stopped)
+	if (!m_bPulseFetched)
+		return;
+
 	Ipp32f bg;
-	ippsMean_32f(m_pScope_PulseView->getRender()->m_pData, m_pScope_PulseView->getRender()->m_sizeGraph.width(), &bg, ippAlgHintFast);
+	ippsMean_32f(m_pulseMean.raw_ptr(), m_pulseMean.length(), &bg, ippAlgHintFast);
 
 	m_pLineEdit_Background->setText(QString::number(bg, 'f', 2));
 
@@ -289,7 +338,7 @@ void PulseCalibDlg::resetChStart0(double start)
 	m_pDataProc->_params.ch_start_ind[0] = ch_ind;
 	m_pConfig->flimChStartInd[0] = ch_ind;
 
-    m_pDataProc->_operator.initiated = false;
+    m_pDataProc->_operator.windows_changed = true;
 
     m_pSpinBox_ChStart[1]->setMinimum((double)(ch_ind + 10) * (double)m_pDataProc->_params.samp_intv);
 
@@ -311,7 +360,7 @@ void PulseCalibDlg::resetChStart1(double start)
 	m_pDataProc->_params.ch_start_ind[1] = ch_ind;
     m_pConfig->flimChStartInd[1] = ch_ind;
 
-    m_pDataProc->_operator.initiated = false;
+    m_pDataProc->_operator.windows_changed = true;
 
 	m_pSpinBox_ChStart[0]->setMaximum((double)(ch_ind - 10) * (double)m_pDataProc->_params.samp_intv);
 	m_pSpinBox_ChStart[2]->setMinimum((double)(ch_ind + 10) * (double)m_pDataProc->_params.samp_intv);
@@ -334,7 +383,7 @@ void PulseCalibDlg::resetChStart2(double start)
 	m_pDataProc->_params.ch_start_ind[2] = ch_ind;
 	m_pConfig->flimChStartInd[2] = ch_ind;
 
-    m_pDataProc->_operator.initiated = false;
+    m_pDataProc->_operator.windows_changed = true;
 
 	m_pSpinBox_ChStart[1]->setMaximum((double)(ch_ind - 10) * (double)m_pDataProc->_params.samp_intv);
 	m_pSpinBox_ChStart[3]->setMinimum((double)(ch_ind + 10) * (double)m_pDataProc->_params.samp_intv);
@@ -357,7 +406,7 @@ void PulseCalibDlg::resetChStart3(double start)
     m_pDataProc->_params.ch_start_ind[3] = ch_ind;
     m_pConfig->flimChStartInd[3] = ch_ind;
 
-    m_pDataProc->_operator.initiated = false;
+    m_pDataProc->_operator.windows_changed = true;
 
     m_pSpinBox_ChStart[2]->setMaximum((double)(ch_ind - 10) * (double)m_pDataProc->_params.samp_intv);
     m_pSpinBox_ChStart[4]->setMinimum((double)(ch_ind + 10) * (double)m_pDataProc->_params.samp_intv);
@@ -380,7 +429,7 @@ void PulseCalibDlg::resetChStart4(double start)
     m_pDataProc->_params.ch_start_ind[4] = ch_ind;
     m_pConfig->flimChStartInd[4] = ch_ind;
 
-    m_pDataProc->_operator.initiated = false;
+    m_pDataProc->_operator.windows_changed = true;
 
     m_pSpinBox_ChStart[3]->setMaximum((double)(ch_ind - 10) * (double)m_pDataProc->_params.samp_intv);
 
@@ -395,3 +444,46 @@ void PulseCalibDlg::resetChStart4(double start)
     m_pScope_PulseView->getRender()->update();
 }
 
+
+
+void PulseCalibDlg::captureTemplate()
+{
+	m_pDataProc->capturePulseTemplate("pulse_template.txt");
+}
+
+void PulseCalibDlg::changeIntensityMode(int)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		m_pDataProc->_params.intensity_mode[i] = m_pComboBox_IntensityMode[i]->currentIndex();
+		m_pConfig->channelIntensityMode[i] = m_pComboBox_IntensityMode[i]->currentIndex();
+	}
+
+	// Crosstalk unmixing is calibrated for normalized intensities (turned off with photon counts)
+	QCheckBox* pCheckBox_Unmixing = m_pDeviceControlTab->getStreamTab()->getCrossTalkUnmixing();
+	if (pCheckBox_Unmixing->isChecked())
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			if (m_pConfig->channelIntensityMode[i] == INTENSITY_PHOTON_COUNTING)
+			{
+				pCheckBox_Unmixing->setChecked(false);
+				emit m_pDeviceControlTab->getStreamTab()->sendStatusMessage("Crosstalk unmixing is turned off for photon counting channels.", true);
+				break;
+			}
+		}
+	}
+}
+
+void PulseCalibDlg::changePhotonThreshold(const QString &str)
+{
+	float thres = str.toFloat();
+
+	m_pDataProc->_params.photon_thres = thres;
+	m_pConfig->photonCountThres = thres;
+}
+
+void PulseCalibDlg::reformImage()
+{
+	m_pDeviceControlTab->getStreamTab()->reformImage();
+}
@@ -12,6 +12,7 @@
 
 #include <Common/array.h>
 #include <Common/callback.h>
+#include <Common/PulseMonitor.h>
 
 #include <ipps.h>
 #include <ippi.h>
@@ -42,7 +43,7 @@ public:
     inline QImageView* getPulseImageView() const { return m_pImageView_PulseImage; }
 
 public slots : // widgets
-	void drawRoiPulse(DataProcess*, int);
+	void drawRoiPulse();
 
 	void showWindow(bool);
 	void splineView(bool);
@@ -55,9 +56,11 @@ public slots : // widgets
 	void resetChStart2(double);
 	void resetChStart3(double);
     void resetChStart4(double);
+	void reformImage();
 
-signals:
-	void plotRoiPulse(DataProcess*, int);
+	void captureTemplate();
+	void changeIntensityMode(int);
+	void changePhotonThreshold(const QString &);
 
 public:
 	// Callbacks
@@ -68,6 +71,13 @@ private:
 	Configuration* m_pConfig;
 	QDeviceControlTab* m_pDeviceControlTab;
 	DataProcess* m_pDataProc;
+	PulseMonitor* m_pPulseMonitor;
+
+	// Pulse monitor (fetched at display rate)
+	QTimer *m_pTimer_Monitor;
+	np::FloatArray m_pulseMean, m_pulseMin, m_pulseMax;
+	np::Uint8Array2 m_pulseImage;
+	bool m_bPulseFetched; // background capture only from a fetched pulse
 
 private:
 	// Layout
@@ -88,6 +98,12 @@ private:
     QLabel *m_pLabel_Ch[5];
     QMySpinBox *m_pSpinBox_ChStart[5];
 	QLabel *m_pLabel_NanoSec;
+
+	QPushButton *m_pPushButton_CaptureTemplate;
+	QLabel *m_pLabel_IntensityMode;
+	QComboBox *m_pComboBox_IntensityMode[4];
+	QLineEdit *m_pLineEdit_PhotonThres;
+	QLabel *m_pLabel_PhotonThres;
 };
 
 #endif // FLIMCALIBDLG_H
@@ -7,8 +7,11 @@
 #include <Doulos/QStreamTab.h>
 #include <Doulos/QOperationTab.h>
 #include <Doulos/QDeviceControlTab.h>
+#include <Doulos/QVisualizationTab.h>
 
 #include <Doulos/Dialog/PulseCalibDlg.h>
+#include <Doulos/Dialog/HistogramDlg.h>
+#include <Doulos/Viewer/QTileView.h>
 
 #include <DataAcquisition/DataAcquisition.h>
 #include <DataAcquisition/DataProcess/DataProcess.h>
@@ -49,7 +52,7 @@ MainWindow::MainWindow(QWidget *parent) :
     m_pTabWidget->addTab(m_pStreamTab, tr("Real-Time Data Streaming"));
 	
     // Create status bar
-    QLabel *pStatusLabel_Temp1 = new QLabel(this); // System Message?
+    m_pStatusLabel_Render = new QLabel(this);
     m_pStatusLabel_ImagePos = new QLabel(QString("[%1] (%2, %3) | (%4)").arg("SHG").arg(0000, 4).arg(0000, 4).arg(0.0, 4, 'f', 3), this);
 	m_pStatusLabel_PmtGain = new QLabel(QString("PMT Gain Voltage: %1 V").arg(0.0, 4, 'f', 3), this);
 
@@ -63,7 +66,7 @@ MainWindow::MainWindow(QWidget *parent) :
     m_pStatusLabel_StageMoving->setStyleSheet("color: red;");
     m_pStatusLabel_StageMoving->setAlignment(Qt::AlignCenter);
 
-    pStatusLabel_Temp1->setFrameStyle(QFrame::Panel | QFrame::Sunken);
+    m_pStatusLabel_Render->setFrameStyle(QFrame::Panel | QFrame::Sunken);
     m_pStatusLabel_ImagePos->setFrameStyle(QFrame::Panel | QFrame::Sunken);
 	m_pStatusLabel_PmtGain->setFrameStyle(QFrame::Panel | QFrame::Sunken);
 
@@ -72,7 +75,7 @@ MainWindow::MainWindow(QWidget *parent) :
     m_pStatusLabel_StageMoving->setFrameStyle(QFrame::Panel | QFrame::Sunken);
 
     // then add the widget to the status bar
-    statusBar()->addPermanentWidget(pStatusLabel_Temp1, 5);
+    statusBar()->addPermanentWidget(m_pStatusLabel_Render, 5);
     statusBar()->addPermanentWidget(m_pStatusLabel_ImagePos, 2);
     statusBar()->addPermanentWidget(m_pStatusLabel_PmtGain, 2);
     statusBar()->addPermanentWidget(m_pStatusLabel_Acquisition, 1);
@@ -114,6 +117,12 @@ void MainWindow::closeEvent(QCloseEvent *e)
 
     if (m_pStreamTab->getDeviceControlTab()->getPulseCalibDlg())
         m_pStreamTab->getDeviceControlTab()->getPulseCalibDlg()->close();
+    if (m_pStreamTab->getVisualizationTab()->getHistogramDlg())
+        m_pStreamTab->getVisualizationTab()->getHistogramDlg()->close();
+#ifndef RAW_PULSE_WRITE
+    if (m_pStreamTab->getTileView())
+        m_pStreamTab->getTileView()->close();
+#endif
 
     e->accept();
 }
@@ -52,6 +52,7 @@ public:
     QResultTab *m_pResultTab;
 
     // Status bar
+    QLabel *m_pStatusLabel_Render;
     QLabel *m_pStatusLabel_ImagePos;
 	QLabel *m_pStatusLabel_PmtGain;
 
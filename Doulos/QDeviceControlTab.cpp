@@ -111,6 +111,12 @@ void QDeviceControlTab::setRelevantWidgets(bool enabled)
     m_pLineEdit_TravelLength->setEnabled(enabled);
     m_pLabel_TargetSpeed->setEnabled(enabled);
     m_pLabel_TravelLength->setEnabled(enabled);
+    m_pToggleButton_Autofocus->setEnabled(enabled);
+    m_pComboBox_AutofocusChannel->setEnabled(enabled);
+    m_pLineEdit_AutofocusRange->setEnabled(enabled);
+    m_pLabel_AutofocusRange->setEnabled(enabled);
+    m_pLineEdit_AutofocusSpeed->setEnabled(enabled);
+    m_pLabel_AutofocusSpeed->setEnabled(enabled);
 
 }
 
@@ -368,6 +374,35 @@ void QDeviceControlTab::createZaberStageControl()
     m_pLabel_TravelLength->setBuddy(m_pLineEdit_TravelLength);
     m_pLabel_TravelLength->setDisabled(true);
 
+    // Autofocus (sweep of the focus axis centered at the current position, during acquisition)
+    m_pToggleButton_Autofocus = new QPushButton(pGroupBox_ZaberStageControl);
+    m_pToggleButton_Autofocus->setText("Autofocus");
+    m_pToggleButton_Autofocus->setCheckable(true);
+    m_pToggleButton_Autofocus->setDisabled(true);
+    m_pComboBox_AutofocusChannel = new QComboBox(pGroupBox_ZaberStageControl);
+    for (int i = 0; i < 4; i++)
+        m_pComboBox_AutofocusChannel->addItem(QString("Ch %1").arg(i + 1));
+    m_pComboBox_AutofocusChannel->setCurrentIndex(m_pConfig->autofocusChannel);
+    m_pComboBox_AutofocusChannel->setDisabled(true);
+    m_pLineEdit_AutofocusRange = new QLineEdit(pGroupBox_ZaberStageControl);
+    m_pLineEdit_AutofocusRange->setFixedWidth(35);
+    m_pLineEdit_AutofocusRange->setText(QString::number(m_pConfig->autofocusRange, 'f', 3));
+    m_pLineEdit_AutofocusRange->setAlignment(Qt::AlignCenter);
+    m_pLineEdit_AutofocusRange->setDisabled(true);
+    m_pLabel_AutofocusRange = new QLabel("mm", pGroupBox_ZaberStageControl);
+    m_pLabel_AutofocusRange->setBuddy(m_pLineEdit_AutofocusRange);
+    m_pLabel_AutofocusRange->setDisabled(true);
+    m_pLineEdit_AutofocusSpeed = new QLineEdit(pGroupBox_ZaberStageControl);
+    m_pLineEdit_AutofocusSpeed->setFixedWidth(35);
+    m_pLineEdit_AutofocusSpeed->setText(QString::number(m_pConfig->autofocusSpeed, 'f', 3));
+    m_pLineEdit_AutofocusSpeed->setAlignment(Qt::AlignCenter);
+    m_pLineEdit_AutofocusSpeed->setToolTip("Focus axis speed during the sweep");
+    m_pLineEdit_AutofocusSpeed->setDisabled(true);
+    m_pLabel_AutofocusSpeed = new QLabel("mm/s", pGroupBox_ZaberStageControl);
+    m_pLabel_AutofocusSpeed->setBuddy(m_pLineEdit_AutofocusSpeed);
+    m_pLabel_AutofocusSpeed->setDisabled(true);
+    m_nAutofocusState = AUTOFOCUS_IDLE;
+
 //    m_pLabel_ScanningStatus = new QLabel("scanning", pGroupBox_ZaberStageControl);
 //    m_pLabel_ScanningStatus->setStyleSheet("font: 12pt; color: red;");
 //    m_pLabel_ScanningStatus->setAlignment(Qt::AlignCenter);
@@ -393,6 +428,13 @@ void QDeviceControlTab::createZaberStageControl()
     //pGridLayout_ZaberStageControl->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed), 4, 0);
     pGridLayout_ZaberStageControl->addWidget(m_pPushButton_Home, 4, 1);
     pGridLayout_ZaberStageControl->addWidget(m_pPushButton_Stop, 4, 2);
+
+    pGridLayout_ZaberStageControl->addWidget(m_pToggleButton_Autofocus, 5, 1);
+    pGridLayout_ZaberStageControl->addWidget(m_pComboBox_AutofocusChannel, 5, 2);
+    pGridLayout_ZaberStageControl->addWidget(m_pLineEdit_AutofocusRange, 5, 3);
+    pGridLayout_ZaberStageControl->addWidget(m_pLabel_AutofocusRange, 5, 4);
+    pGridLayout_ZaberStageControl->addWidget(m_pLineEdit_AutofocusSpeed, 6, 3);
+    pGridLayout_ZaberStageControl->addWidget(m_pLabel_AutofocusSpeed, 6, 4);
 //    pGridLayout_ZaberStageControl->addWidget(m_pLabel_ScanningStatus, 2, 0, 3, 1);
 
 
@@ -406,6 +448,10 @@ void QDeviceControlTab::createZaberStageControl()
     connect(m_pLineEdit_TravelLength, SIGNAL(textChanged(const QString &)), this, SLOT(changeZaberPullbackLength(const QString &)));
     connect(m_pPushButton_Home, SIGNAL(clicked(bool)), this, SLOT(home()));
     connect(m_pPushButton_Stop, SIGNAL(clicked(bool)), this, SLOT(stop()));
+    connect(m_pToggleButton_Autofocus, SIGNAL(toggled(bool)), this, SLOT(startAutofocus(bool)));
+    connect(m_pComboBox_AutofocusChannel, SIGNAL(currentIndexChanged(int)), this, SLOT(changeAutofocusChannel(int)));
+    connect(m_pLineEdit_AutofocusRange, SIGNAL(textChanged(const QString &)), this, SLOT(changeAutofocusRange(const QString &)));
+    connect(m_pLineEdit_AutofocusSpeed, SIGNAL(textChanged(const QString &)), this, SLOT(changeAutofocusSpeed(const QString &)));
 }
 
 
@@ -786,6 +832,8 @@ void QDeviceControlTab::connectZaberStage(bool toggled)
             {
                 std::this_thread::sleep_for(std::chrono::milliseconds(200));
                 m_pZaberStage->setIsMoving(false);
+                if (m_nAutofocusState != AUTOFOCUS_IDLE)
+                    proceedAutofocus();
 #ifndef RAW_PULSE_WRITE
                 if (m_pStreamTab->getOperationTab()->m_pMemoryBuffer->m_bIsRecordingImage)
                     if (m_pStreamTab->getImageStitchingCheckBox()->isChecked())
@@ -816,6 +864,12 @@ void QDeviceControlTab::connectZaberStage(bool toggled)
         m_pLineEdit_TargetSpeed->setEnabled(true);
         m_pLabel_TravelLength->setEnabled(true);
         m_pLabel_TargetSpeed->setEnabled(true);
+        m_pToggleButton_Autofocus->setEnabled(true);
+        m_pComboBox_AutofocusChannel->setEnabled(true);
+        m_pLineEdit_AutofocusRange->setEnabled(true);
+        m_pLabel_AutofocusRange->setEnabled(true);
+        m_pLineEdit_AutofocusSpeed->setEnabled(true);
+        m_pLabel_AutofocusSpeed->setEnabled(true);
 
 #ifndef RAW_PULSE_WRITE
         m_pStreamTab->getImageStitchingCheckBox()->setEnabled(true);
@@ -848,6 +902,14 @@ void QDeviceControlTab::connectZaberStage(bool toggled)
         m_pLineEdit_TargetSpeed->setEnabled(false);
         m_pLabel_TravelLength->setEnabled(false);
         m_pLabel_TargetSpeed->setEnabled(false);
+        if (m_pToggleButton_Autofocus->isChecked())
+            m_pToggleButton_Autofocus->setChecked(false);
+        m_pToggleButton_Autofocus->setEnabled(false);
+        m_pComboBox_AutofocusChannel->setEnabled(false);
+        m_pLineEdit_AutofocusRange->setEnabled(false);
+        m_pLabel_AutofocusRange->setEnabled(false);
+        m_pLineEdit_AutofocusSpeed->setEnabled(false);
+        m_pLabel_AutofocusSpeed->setEnabled(false);
 
         if (m_pZaberStage)
         {
@@ -904,3 +966,104 @@ void QDeviceControlTab::getCurrentPosition()
 {
     m_pZaberStage->GetPos();
 }
+
+void QDeviceControlTab::startAutofocus(bool toggled)
+{
+    QStreamTab* pStreamTab = getStreamTab();
+    if (toggled)
+    {
+        if (!pStreamTab->getOperationTab()->isAcquisitionButtonToggled())
+        {
+            emit pStreamTab->sendStatusMessage("Autofocus requires a running acquisition.", true);
+            m_pToggleButton_Autofocus->setChecked(false);
+            return;
+        }
+
+        // 1. Move to the start of the sweep
+        m_pToggleButton_Autofocus->setText("Stop Focus");
+        m_nAutofocusState = AUTOFOCUS_MOVE_START;
+        m_pZaberStage->MoveRelative(ZABER_FOCUS_AXIS, -m_pConfig->autofocusRange / 2);
+    }
+    else
+    {
+        // Aborted (stays where it is)
+        if (m_nAutofocusState != AUTOFOCUS_IDLE)
+        {
+            m_pZaberStage->Stop(ZABER_FOCUS_AXIS);
+            if (m_nAutofocusState == AUTOFOCUS_SWEEP) // manual speed back
+                m_pZaberStage->SetTargetSpeed(ZABER_FOCUS_AXIS, m_pLineEdit_TargetSpeed->text().toDouble());
+            pStreamTab->m_focusSweep.end();
+            m_nAutofocusState = AUTOFOCUS_IDLE;
+            emit pStreamTab->sendStatusMessage("Autofocus is stopped.", false);
+        }
+        m_pToggleButton_Autofocus->setText("Autofocus");
+    }
+}
+
+void QDeviceControlTab::proceedAutofocus()
+{
+    // Called when the focus axis has become idle
+    QStreamTab* pStreamTab = getStreamTab();
+    double range = m_pConfig->autofocusRange;
+
+    switch (m_nAutofocusState)
+    {
+    case AUTOFOCUS_MOVE_START:
+    {
+        // 2. Continuous sweep: every averaged image formed meanwhile is a sample (no stop & go per step)
+        // (sweep speed set only for the sweep, the focus position is estimated from it)
+        m_nAutofocusState = AUTOFOCUS_SWEEP;
+        m_pZaberStage->SetTargetSpeed(ZABER_FOCUS_AXIS, m_pConfig->autofocusSpeed);
+        pStreamTab->m_focusSweep.begin(m_pConfig->autofocusSpeed, range);
+        m_pZaberStage->MoveRelative(ZABER_FOCUS_AXIS, range);
+        break;
+    }
+    case AUTOFOCUS_SWEEP:
+    {
+        // 3. Settle at the optimum (back to the center if the sweep was too short)
+        pStreamTab->m_focusSweep.end();
+        m_nAutofocusState = AUTOFOCUS_MOVE_BEST;
+        m_pZaberStage->SetTargetSpeed(ZABER_FOCUS_AXIS, m_pLineEdit_TargetSpeed->text().toDouble()); // manual speed back
+
+        double pos;
+        if (pStreamTab->m_focusSweep.best(pos))
+        {
+            m_pZaberStage->MoveRelative(ZABER_FOCUS_AXIS, pos - range);
+            emit pStreamTab->sendStatusMessage(QString("Autofocus: best focus at %1 mm of the sweep (%2 images).")
+                .arg(pos - range / 2, 0, 'f', 4).arg(pStreamTab->m_focusSweep.getCount()), false);
+        }
+        else
+        {
+            m_pZaberStage->MoveRelative(ZABER_FOCUS_AXIS, -range / 2);
+            emit pStreamTab->sendStatusMessage(QString("Autofocus failed: too few images (%1) in the sweep. Lower the autofocus speed.")
+                .arg(pStreamTab->m_focusSweep.getCount()), true);
+        }
+        break;
+    }
+    case AUTOFOCUS_MOVE_BEST:
+        m_nAutofocusState = AUTOFOCUS_IDLE;
+        m_pToggleButton_Autofocus->setChecked(false);
+        break;
+    default:
+        break;
+    }
+}
+
+void QDeviceControlTab::changeAutofocusChannel(int ch)
+{
+    m_pConfig->autofocusChannel = ch;
+}
+
+void QDeviceControlTab::changeAutofocusRange(const QString &str)
+{
+    float range = str.toFloat();
+    if (range > 0)
+        m_pConfig->autofocusRange = range;
+}
+
+void QDeviceControlTab::changeAutofocusSpeed(const QString &str)
+{
+    float speed = str.toFloat();
+    if (speed > 0)
+        m_pConfig->autofocusSpeed = speed;
+}
@@ -24,6 +24,8 @@ class ZaberStage;
 
 class QImageView;
 
+enum AutofocusState { AUTOFOCUS_IDLE, AUTOFOCUS_MOVE_START, AUTOFOCUS_SWEEP, AUTOFOCUS_MOVE_BEST };
+
 class QMySpinBox : public QDoubleSpinBox
 {
 public:
@@ -72,6 +74,7 @@ private: ///////////////////////////////////////////////////////////////////////
 	void createResonantScanControl();
     void createGalvoScanControl();
     void createZaberStageControl();
+    void proceedAutofocus();
 
 private slots: /////////////////////////////////////////////////////////////////////////////////////////
     // FLIm PMT Gain Control
@@ -105,6 +108,10 @@ private slots: /////////////////////////////////////////////////////////////////
     void stop();
     void stageScan(int, double);
     void getCurrentPosition();
+    void startAutofocus(bool);
+    void changeAutofocusChannel(int);
+    void changeAutofocusRange(const QString &);
+    void changeAutofocusSpeed(const QString &);
 
 signals: ////////////////////////////////////////////////////////////////////////////////////////////////
     void startStageScan(int, double);
@@ -124,6 +131,7 @@ private: ///////////////////////////////////////////////////////////////////////
 
     // Zaber Stage Control;
     ZaberStage* m_pZaberStage;
+    AutofocusState m_nAutofocusState;
 	
 private: ////////////////////////////////////////////////////////////////////////////////////////////////
     QStreamTab* m_pStreamTab;
@@ -178,6 +186,12 @@ private: ///////////////////////////////////////////////////////////////////////
     QLineEdit *m_pLineEdit_TravelLength;
     QLabel *m_pLabel_TargetSpeed;
     QLabel *m_pLabel_TravelLength;
+    QPushButton *m_pToggleButton_Autofocus;
+    QComboBox *m_pComboBox_AutofocusChannel;
+    QLineEdit *m_pLineEdit_AutofocusRange;
+    QLabel *m_pLabel_AutofocusRange;
+    QLineEdit *m_pLineEdit_AutofocusSpeed;
+    QLabel *m_pLabel_AutofocusSpeed;
 };
 
 #endif // QDEVICECONTROLTAB_H
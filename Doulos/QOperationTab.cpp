@@ -100,6 +100,7 @@ void QOperationTab::operateDataAcquisition(bool toggled)
         if (m_pDataAcquisition->InitializeAcquistion())
         {
             // Start Thread Process
+            m_pStreamTab->resetVisualizationBuffers();
             m_pStreamTab->m_pThreadVisualization->startThreading();
             m_pStreamTab->m_pThreadDataProcess->startThreading();
 
@@ -7,6 +7,7 @@
 #include <Doulos/QVisualizationTab.h>
 
 #include <Doulos/Dialog/PulseCalibDlg.h>
+#include <Doulos/Viewer/QTileView.h>
 
 #include <DataAcquisition/DataAcquisition.h>
 #include <DataAcquisition/ThreadManager.h>
@@ -68,6 +69,13 @@ QStreamTab::QStreamTab(QWidget *parent) :
 	m_pLineEdit_Averaging->setAlignment(Qt::AlignCenter);
 	m_pLineEdit_Averaging->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
 
+	m_pComboBox_AveragingMode = new QComboBox(this);
+	m_pComboBox_AveragingMode->addItem("Block");
+	m_pComboBox_AveragingMode->addItem("Exponential");
+	m_pComboBox_AveragingMode->addItem("Sliding");
+	m_pComboBox_AveragingMode->setCurrentIndex(m_pConfig->imageAveragingMode);
+	m_pComboBox_AveragingMode->setToolTip("Block: one image per N frames / Exponential & Sliding: running average refreshed every frame");
+
 	m_pLabel_AcquisitionStatusMsg = new QLabel(this);
 #ifndef RAW_PULSE_WRITE
     QString str; str.sprintf("Acc : %3d / %3d   Avg : %3d / %3d   Rec : %4d / %4d",
@@ -96,16 +104,41 @@ QStreamTab::QStreamTab(QWidget *parent) :
     m_pCheckBox_CRSNonlinearityComp = new QCheckBox(this);
     m_pCheckBox_CRSNonlinearityComp->setText("CRS Nonlinearity Compensation");
 
-    m_pCRSCompIdx = np::FloatArray2(m_pConfig->nPixels, 2);
-    for (int i = 0; i < m_pConfig->nPixels; i++)
-    {
-        m_pCRSCompIdx(i, 0) = i;
-        m_pCRSCompIdx(i, 1) = 1;
-    }
+    m_scanCompensation.initialize(m_pConfig->nPixels, m_pConfig->nLines);
 
     m_pCheckBox_CRSNonlinearityComp->setChecked(m_pConfig->crsCompensation);
     if (m_pConfig->crsCompensation) changeCRSNonlinearityComp(true);
 
+    // Spectral crosstalk unmixing
+    m_pCheckBox_CrossTalkUnmixing = new QCheckBox(this);
+    m_pCheckBox_CrossTalkUnmixing->setText("Crosstalk Unmixing");
+    m_pCheckBox_CrossTalkUnmixing->setChecked(m_pConfig->crossTalkUnmixing);
+
+    // Dark-frame & flat-field correction
+    m_pCheckBox_FlatFieldCorrection = new QCheckBox(this);
+    m_pCheckBox_FlatFieldCorrection->setText("Dark/Flat Correction");
+
+    m_pPushButton_CaptureDark = new QPushButton(this);
+    m_pPushButton_CaptureDark->setText("Capture Dark");
+    m_pPushButton_CaptureFlat = new QPushButton(this);
+    m_pPushButton_CaptureFlat->setText("Capture Flat");
+
+    m_pLineEdit_FlatFieldFrames = new QLineEdit(this);
+    m_pLineEdit_FlatFieldFrames->setFixedWidth(25);
+    m_pLineEdit_FlatFieldFrames->setText(QString::number(m_pConfig->flatFieldFrames));
+    m_pLineEdit_FlatFieldFrames->setAlignment(Qt::AlignCenter);
+    m_pLineEdit_FlatFieldFrames->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
+    m_pLineEdit_FlatFieldFrames->setToolTip("Number of frames averaged for dark/flat capture");
+
+    m_flatField.initialize(m_pConfig->nPixels, m_pConfig->nLines, 4);
+    m_histogram.initialize(4, m_pConfig->nLines - GALVO_FLYING_BACK);
+    m_pulseMonitor.initialize(m_pConfig->nScans, m_pConfig->nPixels);
+    for (int i = 0; i < 4; i++)
+        m_focusValue[i] = 0.0f;
+    m_bFlatFieldCorrection = false;
+    m_pCheckBox_FlatFieldCorrection->setChecked(m_pConfig->flatFieldCorrection);
+    if (m_pConfig->flatFieldCorrection) changeFlatFieldCorrection(true);
+
 #ifndef RAW_PULSE_WRITE
     // Image stitching mode
     m_pCheckBox_StitchingMode = new QCheckBox(this);
@@ -130,6 +163,11 @@ QStreamTab::QStreamTab(QWidget *parent) :
     m_pLineEdit_YStep->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
     m_pLineEdit_YStep->setDisabled(true);
 
+    m_pPushButton_MosaicViewer = new QPushButton(this);
+    m_pPushButton_MosaicViewer->setText("Mosaic...");
+    m_pPushButton_MosaicViewer->setFixedWidth(60);
+    m_pTileView = nullptr;
+
 //    m_pLabel_MisSyncPos = new QLabel("Mis-Sync Position", this);
 //    m_pLabel_MisSyncPos->setAlignment(Qt::AlignRight | Qt::AlignVCenter);
 //    m_pLabel_MisSyncPos->setDisabled(true);
@@ -154,6 +192,7 @@ QStreamTab::QStreamTab(QWidget *parent) :
     pGridLayout_Averaging->addWidget(m_pLineEdit_Accumulation, 0, 2);
     pGridLayout_Averaging->addWidget(m_pLabel_Averaging, 0, 3);
     pGridLayout_Averaging->addWidget(m_pLineEdit_Averaging, 0, 4);
+    pGridLayout_Averaging->addWidget(m_pComboBox_AveragingMode, 0, 5);
 
     pGridLayout_Averaging->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed), 1, 0);
     pGridLayout_Averaging->addWidget(m_pLabel_AcquisitionStatusMsg, 1, 1, 1, 4);
@@ -171,10 +210,22 @@ QStreamTab::QStreamTab(QWidget *parent) :
     pHBoxLayout_CRS->setSpacing(2);
 
     pHBoxLayout_CRS->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed));
+    pHBoxLayout_CRS->addWidget(m_pCheckBox_CrossTalkUnmixing);
     pHBoxLayout_CRS->addWidget(m_pCheckBox_CRSNonlinearityComp);
 
     pGridLayout_Averaging->addItem(pHBoxLayout_CRS, 3, 0, 1, 5);
 
+    QHBoxLayout *pHBoxLayout_FlatField = new QHBoxLayout;
+    pHBoxLayout_FlatField->setSpacing(2);
+
+    pHBoxLayout_FlatField->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed));
+    pHBoxLayout_FlatField->addWidget(m_pCheckBox_FlatFieldCorrection);
+    pHBoxLayout_FlatField->addWidget(m_pLineEdit_FlatFieldFrames);
+    pHBoxLayout_FlatField->addWidget(m_pPushButton_CaptureDark);
+    pHBoxLayout_FlatField->addWidget(m_pPushButton_CaptureFlat);
+
+    pGridLayout_Averaging->addItem(pHBoxLayout_FlatField, 4, 0, 1, 5);
+
 #ifndef RAW_PULSE_WRITE
     QGridLayout *pGridLayout_ImageStitching = new QGridLayout;
     pGridLayout_ImageStitching->setSpacing(2);
@@ -185,12 +236,13 @@ QStreamTab::QStreamTab(QWidget *parent) :
     pGridLayout_ImageStitching->addWidget(m_pLineEdit_XStep, 0, 3);
     pGridLayout_ImageStitching->addWidget(m_pLabel_YStep, 0, 4);
     pGridLayout_ImageStitching->addWidget(m_pLineEdit_YStep, 0, 5);
+    pGridLayout_ImageStitching->addWidget(m_pPushButton_MosaicViewer, 0, 6);
 
 //    pGridLayout_ImageStitching->addItem(new QSpacerItem(0, 0, QSizePolicy::MinimumExpanding, QSizePolicy::Fixed), 1, 0, 1, 2);
 //    pGridLayout_ImageStitching->addWidget(m_pLabel_MisSyncPos, 1, 2, 1, 3);
 //    pGridLayout_ImageStitching->addWidget(m_pLineEdit_MisSyncPos, 1, 5);
 
-    pGridLayout_Averaging->addItem(pGridLayout_ImageStitching, 4, 0, 1, 5);
+    pGridLayout_Averaging->addItem(pGridLayout_ImageStitching, 5, 0, 1, 5);
 #endif
 
 	m_pVisualizationTab->getAveragingBox()->setLayout(pGridLayout_Averaging);
@@ -219,14 +271,29 @@ QStreamTab::QStreamTab(QWidget *parent) :
 	m_pThreadDataProcess = new ThreadManager("Image process");
 	m_pThreadVisualization = new ThreadManager("Visualization process");
 
+	// Re-form worker (edited channel windows are re-rendered off the UI thread, also while acquisition is stopped)
+	m_bReformRequest = m_bReformStop = false;
+	m_pThreadReform = new ThreadManager("Re-form process");
+	m_pThreadReform->DidAcquireData += [&](int) { reformCachedImage(); };
+	m_pThreadReform->DidStopData += [&]() {
+		{
+			std::unique_lock<std::mutex> lock(m_mtxReform);
+			m_bReformStop = true;
+		}
+		m_cvReform.notify_one();
+		m_pThreadReform->_running = false;
+	};
+	m_pThreadReform->startThreading();
+
 	// Create buffers for threading operation
     m_pOperationTab->m_pMemoryBuffer->m_syncImageBuffer.allocate_queue_buffer(m_pConfig->nPixels /* width */ * m_pConfig->nLines * 4 /* height */, PROCESSING_BUFFER_SIZE);
 #ifdef RAW_PULSE_WRITE
 	m_pOperationTab->m_pMemoryBuffer->m_syncBuffering.allocate_queue_buffer(m_pConfig->nSegments /* width */ * m_pConfig->nTimes /* height */, PROCESSING_BUFFER_SIZE);
 #endif
 	m_syncDataProcessing.allocate_queue_buffer(m_pConfig->nSegments /* width */ * m_pConfig->nTimes /* height */, PROCESSING_BUFFER_SIZE);
-	m_syncDataVisualization.allocate_queue_buffer((m_pConfig->nSegments * m_pConfig->nTimes) / 2 /* raw pulse */ 
-												   + (m_pConfig->nPixels * m_pConfig->nTimes /* width */ * 4 /* height */), PROCESSING_BUFFER_SIZE);
+	m_bLifetimeRendering = false;
+	m_nVisualizationPlanes = 0;
+	resetVisualizationBuffers();
 
 	// Set signal object
 	setDataAcquisitionCallback();
@@ -253,12 +320,19 @@ QStreamTab::QStreamTab(QWidget *parent) :
     connect(m_pTimer_Monitoring, SIGNAL(timeout()), this, SLOT(onTimerMonitoring()));
 	connect(m_pLineEdit_Accumulation, SIGNAL(textChanged(const QString &)), this, SLOT(changeAccumulationFrame(const QString &)));
 	connect(m_pLineEdit_Averaging, SIGNAL(textChanged(const QString &)), this, SLOT(changeAveragingFrame(const QString &)));
+	connect(m_pComboBox_AveragingMode, SIGNAL(currentIndexChanged(int)), this, SLOT(changeAveragingMode(int)));
 	connect(m_pSlider_SyncComp, SIGNAL(valueChanged(int)), this, SLOT(setSyncComp(int)));
     connect(m_pCheckBox_CRSNonlinearityComp, SIGNAL(toggled(bool)), this, SLOT(changeCRSNonlinearityComp(bool)));
+    connect(m_pCheckBox_CrossTalkUnmixing, SIGNAL(toggled(bool)), this, SLOT(changeCrossTalkUnmixing(bool)));
+    connect(m_pCheckBox_FlatFieldCorrection, SIGNAL(toggled(bool)), this, SLOT(changeFlatFieldCorrection(bool)));
+    connect(m_pPushButton_CaptureDark, SIGNAL(clicked(bool)), this, SLOT(captureDarkFrame()));
+    connect(m_pPushButton_CaptureFlat, SIGNAL(clicked(bool)), this, SLOT(captureFlatField()));
+    connect(m_pLineEdit_FlatFieldFrames, SIGNAL(textChanged(const QString &)), this, SLOT(changeFlatFieldFrames(const QString &)));
 #ifndef RAW_PULSE_WRITE
     connect(m_pCheckBox_StitchingMode, SIGNAL(toggled(bool)), this, SLOT(enableStitchingMode(bool)));
     connect(m_pLineEdit_XStep, SIGNAL(textChanged(const QString &)), this, SLOT(changeStitchingXStep(const QString &)));
     connect(m_pLineEdit_YStep, SIGNAL(textChanged(const QString &)), this, SLOT(changeStitchingYStep(const QString &)));
+    connect(m_pPushButton_MosaicViewer, SIGNAL(clicked(bool)), this, SLOT(createMosaicViewer()));
 //    connect(m_pLineEdit_MisSyncPos, SIGNAL(textChanged(const QString &)), this, SLOT(changeStitchingMisSyncPos(const QString &)));
 #endif
 }
@@ -267,6 +341,8 @@ QStreamTab::~QStreamTab()
 {    
     m_pTimer_Monitoring->stop();
 
+	m_pThreadReform->stopThreading();
+	delete m_pThreadReform;
 	if (m_pThreadVisualization) delete m_pThreadVisualization;
 	if (m_pThreadDataProcess) delete m_pThreadDataProcess;
 }
@@ -288,6 +364,7 @@ void QStreamTab::setAveragingWidgets(bool enabled)
 	m_pLineEdit_Accumulation->setEnabled(enabled);
 	m_pLabel_Averaging->setEnabled(enabled);
 	m_pLineEdit_Averaging->setEnabled(enabled);
+	m_pComboBox_AveragingMode->setEnabled(enabled);
 	m_pLabel_SyncComp->setEnabled(enabled);
 	m_pSlider_SyncComp->setEnabled(enabled);
     m_pCheckBox_CRSNonlinearityComp->setEnabled(enabled);
@@ -412,7 +489,12 @@ void QStreamTab::setDataProcessingCallback()
 				
 				float* image_ptr = data_ptr + m_pConfig->bufferSize / 2;
 				np::FloatArray2 intensity(image_ptr, m_pConfig->nPixels * m_pConfig->nTimes, 4);
-				(*pDataProc)(intensity, pulse1);
+				np::FloatArray2 lifetime;
+				if (m_bLifetimeRendering)
+					lifetime = np::FloatArray2(image_ptr + 4 * m_pConfig->nPixels * m_pConfig->nTimes, m_pConfig->nPixels * m_pConfig->nTimes, 4);
+				int chunk = frame_count % (m_pConfig->nLines / m_pConfig->nTimes);
+				(*pDataProc)(intensity, pulse1, chunk * m_pConfig->nPixels * m_pConfig->nTimes, m_pConfig->imageSize,
+					m_bLifetimeRendering ? &lifetime : nullptr);
 
 				//// Pulse Data
 				//QFile file("pulse.data");
@@ -422,15 +504,15 @@ void QStreamTab::setDataProcessingCallback()
 				//	file.close();
 				//}
 
-				// Transfer to FLIm calibration dlg
-				if (m_pDeviceControlTab->getPulseCalibDlg())
+				// Pulse monitor tap (selected A-line of the raw pulses, while the calibration dlg is open)
+				if (m_pulseMonitor.isEnabled())
 				{
-					int x, y;
-					m_pVisualizationTab->getPixelPos(&x, &y);
-                    m_pDeviceControlTab->getPulseCalibDlg()->getPulseImageView()->setHorizontalLine(1, x);
-
-					if ((frame_count % (m_pConfig->nLines / m_pConfig->nTimes)) == (y / m_pConfig->nTimes))
-						emit m_pDeviceControlTab->getPulseCalibDlg()->plotRoiPulse(pDataProc, (y % m_pConfig->nTimes) * m_pConfig->nPixels + x);
+					int x = m_pulseMonitor.getAline(), y = m_pulseMonitor.getLine();
+					if (chunk == (y / m_pConfig->nTimes))
+					{
+						int line = (y % m_pConfig->nTimes) * m_pConfig->nPixels;
+						m_pulseMonitor.push(&pulse1(0, line + x), &pulse1(0, line));
+					}
 				}
 
 				// Push the buffers to sync Queues
@@ -480,6 +562,8 @@ void QStreamTab::setVisualizationCallback()
 			writtenSamples = 0;
 			dwTickStart = GetTickCount();
 			dwTickLastUpdate = GetTickCount();
+
+			m_runningAverage.initialize(m_pConfig->nPixels, 4 * m_pConfig->nLines, m_pConfig->imageAveragingFrames, m_pConfig->imageAveragingMode);
 		}
 		
 		// Get the buffers from the previous sync Queues
@@ -489,18 +573,38 @@ void QStreamTab::setVisualizationCallback()
 			// Body
 			if (m_pOperationTab->isAcquisitionButtonToggled()) // Only valid if acquisition is running 
 			{
-				// Averaging buffer
-				if ((m_nAcquiredFrames == 0) && (writtenSamples == 0))
+				// Averaging buffer (running averages clear it while pushing the accumulated frame)
+				bool running = (m_pConfig->imageAveragingMode != AVERAGING_BLOCK);
+				if ((m_nAcquiredFrames == 0) && (writtenSamples == 0) && (!running || (frame_count == 0)))
 				{
 					m_pTempImage = np::FloatArray2(m_pConfig->nPixels, 4 * m_pConfig->nLines);
 					memset(m_pTempImage, 0, sizeof(float) * m_pTempImage.length());
 				}
 
-				// Data copy (SHG / TPFE / CARS / RCM)
+				// Data copy (SHG / TPFE / CARS / RCM) into the final rows
 				float* image_ptr = data_ptr + m_pConfig->bufferSize / 2;
 				np::FloatArray2 data(image_ptr, m_pConfig->nPixels * m_pConfig->nTimes, 4);
 				for (int i = 0; i < 4; i++)
-					ippsAdd_32f_I(&data(0, i), &m_pTempImage(0, i * m_pConfig->nLines) + writtenSamples, m_pConfig->nPixels * m_pConfig->nTimes);
+					addLines(&data(0, i), writtenSamples / m_pConfig->nPixels, m_pConfig->nTimes, &m_pTempImage(0, i * m_pConfig->nLines));
+				bool lifetime = m_bLifetimeRendering;
+				if (lifetime && ((m_pTempLifetime.length() != m_pTempImage.length()) || ((m_nAcquiredFrames == 0) && (writtenSamples == 0) && !running)))
+				{
+					m_pTempLifetime = np::FloatArray2(m_pConfig->nPixels, 4 * m_pConfig->nLines);
+					m_pTempLifetimeWeight = np::FloatArray2(m_pConfig->nPixels, 4 * m_pConfig->nLines);
+					memset(m_pTempLifetime, 0, sizeof(float) * m_pTempLifetime.length());
+					memset(m_pTempLifetimeWeight, 0, sizeof(float) * m_pTempLifetimeWeight.length());
+				}
+				if (lifetime)
+				{
+					// Intensity-weighted delays & weights (intensity thresholded in place, after its accumulation)
+					np::FloatArray2 lifetime_data(image_ptr + 4 * m_pConfig->nPixels * m_pConfig->nTimes, m_pConfig->nPixels * m_pConfig->nTimes, 4);
+					ippsThreshold_LT_32f_I(data.raw_ptr(), data.length(), 0.0f);
+					for (int i = 0; i < 4; i++)
+					{
+						addLines(&lifetime_data(0, i), writtenSamples / m_pConfig->nPixels, m_pConfig->nTimes, &m_pTempLifetime(0, i * m_pConfig->nLines));
+						addLines(&data(0, i), writtenSamples / m_pConfig->nPixels, m_pConfig->nTimes, &m_pTempLifetimeWeight(0, i * m_pConfig->nLines));
+					}
+				}
 				writtenSamples += m_pConfig->nPixels * m_pConfig->nTimes;
 				
 #ifdef RAW_PULSE_WRITE
@@ -568,50 +672,63 @@ void QStreamTab::setVisualizationCallback()
 #endif
 					m_pLabel_AcquisitionStatusMsg->setText(str);
 
-					// Visualization
-					if (m_nAcquiredFrames == (m_pConfig->imageAveragingFrames * m_pConfig->imageAccumulationFrames))
-                    {
-						for (int i = 0; i < 4; i++)
-                        {
-                            // Averaging
-                            ippsDivC_32f(&m_pTempImage(0, i * m_pConfig->nLines), m_pConfig->imageAveragingFrames,
-                                         m_pVisualizationTab->m_vecVisImage.at(i).raw_ptr(), m_pConfig->imageSize);
-
-                            // CRS nonlinear scanning compensation                            
-                            np::FloatArray2 scanArray0(m_pVisualizationTab->m_vecVisImage.at(i).raw_ptr(), m_pConfig->nPixels, m_pConfig->nLines);
-                            np::FloatArray2 scanArray1(m_pConfig->nPixels, m_pConfig->nLines);
-                            memcpy(scanArray1, scanArray0, sizeof(float) * scanArray1.length());
-
-                            if (m_pCheckBox_CRSNonlinearityComp->isChecked())
-                            {
-                                np::FloatArray comp_index(&m_pCRSCompIdx(0, 0), m_pConfig->nPixels);
-                                np::FloatArray comp_weight(&m_pCRSCompIdx(0, 1), m_pConfig->nPixels);
-
-                                tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)m_pConfig->nLines),
-                                    [&](const tbb::blocked_range<size_t>& r) {
-                                    for (size_t j = r.begin(); j != r.end(); ++j)
-                                    {
-                                        float* fast_scan = &scanArray0(0, (int)j);
-                                        float* comp_scan = &scanArray1(0, (int)j);
-
-                                        for (int k = 0; k < m_pConfig->nPixels; k++)
-                                            comp_scan[k] = comp_weight[k] * fast_scan[(int)comp_index[k]]
-                                                    + (1 - comp_weight[k]) * fast_scan[(int)comp_index[k] + 1];
-                                    }
-                                });
+					// Averaging: block average once per N frames, running averages on every accumulated frame
+					bool formed = false, completed = false;
+					{
+						std::unique_lock<std::mutex> lock(m_mtxImageFormation);
+						m_flatField.applyRequest();
+						m_runningAverage.applyRequest();
+					}
+					bool capturing = m_flatField.isCapturing();
+					if (!running)
+					{
+						if (m_nAcquiredFrames == (m_pConfig->imageAveragingFrames * m_pConfig->imageAccumulationFrames))
+						{
+							formImage(m_pTempImage, 1.0f / (float)m_pConfig->imageAveragingFrames, capturing,
+								nullptr, lifetime ? formLifetime() : nullptr);
+							formed = completed = true;
+						}
+					}
+					else if (!(m_nAcquiredFrames % m_pConfig->imageAccumulationFrames))
+					{
+						const float* lifetime_ptr = lifetime ? formLifetime() : nullptr; // before the push clears the frame
+						m_runningAverage.push(m_pTempImage.raw_ptr());
+						formImage(m_runningAverage.getImage(), m_runningAverage.getScale(), capturing, nullptr, lifetime_ptr);
+						formed = true;
+						completed = m_runningAverage.isFull(); // window of N frames
+					}
 
-                                memcpy(scanArray0.raw_ptr(), scanArray1.raw_ptr(), sizeof(float) * scanArray1.length());
-                            }
+					// Sharpness of the formed image (live metric & autofocus sweep, galvo flyback rows excluded)
+					if (formed && (m_pConfig->focusMetric || m_focusSweep.isRunning()))
+					{
+						std::unique_lock<std::mutex> lock(m_mtxImageFormation);
+						const np::FloatArray2& image = m_pVisualizationTab->m_visImageBuffer.getLatest();
+						m_focusMetric.setMode(m_pConfig->focusMetricMode);
+						for (int i = 0; i < 4; i++)
+							if (m_pConfig->focusMetric || (i == m_pConfig->autofocusChannel))
+								m_focusValue[i] = m_focusMetric(&image(0, i * m_pConfig->nLines), m_pConfig->nPixels, m_pConfig->nLines - GALVO_FLYING_BACK);
+						m_focusSweep.add(m_focusValue[m_pConfig->autofocusChannel], running ? m_runningAverage.getLag() : 0.5);
+					}
 
-                            ippiCopy_32f_C1R(&scanArray1(0, GALVO_SHIFT), sizeof(float) * m_pConfig->nPixels,
-                                             &scanArray0(0, 0), sizeof(float) * m_pConfig->nPixels, { m_pConfig->nPixels, m_pConfig->nLines - GALVO_SHIFT });
-                            ippiCopy_32f_C1R(&scanArray1(0, 0), sizeof(float) * m_pConfig->nPixels,
-                                             &scanArray0(0, m_pConfig->nLines - GALVO_SHIFT), sizeof(float) * m_pConfig->nPixels, { m_pConfig->nPixels, GALVO_SHIFT });
-                        }
+					// Dark-frame & flat-field map capture
+					if (formed && capturing)
+					{
+						std::unique_lock<std::mutex> lock(m_mtxImageFormation);
+						int mode = m_flatField.finishFrame();
+						if (mode != FLAT_FIELD_IDLE)
+						{
+							bool saved = m_flatField.save("dark_frame.bin", "flat_field.bin");
+							QString msg = QString("%1 map is captured (%2 frames)%3").arg(mode == FLAT_FIELD_DARK ? "Dark-frame" : "Flat-field")
+									.arg(m_pConfig->flatFieldFrames).arg(saved ? "." : ", but failed to save.");
+							emit sendStatusMessage(msg, !saved);
+						}
+					}
 
+					// Visualization
+					if (completed)
+                    {
 						// Draw Images
 						updateFrames++;
-						emit m_pVisualizationTab->drawImage();
 
                         // Buffering (When recording)
                         if (pMemBuff->m_bIsRecordingImage && !m_bIsStageTransition)
@@ -639,9 +756,10 @@ void QStreamTab::setVisualizationCallback()
                                     if (image_ptr != nullptr)
                                     {
                                         // Body (Copying the frame data)
-                                        for (int i = 0; i < 4; i++)
-                                            memcpy(image_ptr + i * m_pConfig->imageSize,
-                                                   m_pVisualizationTab->m_vecVisImage.at(i).raw_ptr(), sizeof(float) * m_pConfig->imageSize);
+                                        {
+                                            std::unique_lock<std::mutex> lock(m_mtxImageFormation);
+                                            memcpy(image_ptr, m_pVisualizationTab->m_visImageBuffer.getLatest().raw_ptr(), sizeof(float) * 4 * m_pConfig->imageSize);
+                                        }
 
                                         // Push to the copy queue for copying transfered data in copy thread
                                         pMemBuff->m_syncImageBuffer.Queue_sync.push(image_ptr);
@@ -705,9 +823,13 @@ void QStreamTab::setVisualizationCallback()
 							updateFrames = 0;
 						}						
 
-                        // Re-initializing
+                        // Re-initializing (a running average restarts so that the next recorded image has only fresh frames)
 						m_nAcquiredFrames = 0;
-                        if (pMemBuff->m_bIsRecordingImage && !m_bIsStageTransition) pMemBuff->m_bIsFirstRecImage = true;
+                        if (pMemBuff->m_bIsRecordingImage && !m_bIsStageTransition && !pMemBuff->m_bIsFirstRecImage)
+                        {
+                            pMemBuff->m_bIsFirstRecImage = true;
+                            if (running) m_runningAverage.reset();
+                        }
 					}
 
 					// Re-initializing
@@ -737,6 +859,157 @@ void QStreamTab::setVisualizationCallback()
 }
 
 
+void QStreamTab::addLines(const float* src, int first_line, int n_lines, float* dst)
+{
+    // Scan line l is stored in row (l - GALVO_SHIFT) mod nLines, galvo flyback rows are never written
+    int valid_lines = m_pConfig->nLines - GALVO_FLYING_BACK;
+    for (int i = 0; i < n_lines; i++)
+    {
+        int row = (first_line + i - GALVO_SHIFT + m_pConfig->nLines) % m_pConfig->nLines;
+        if (row < valid_lines)
+            ippsAdd_32f_I(src + i * m_pConfig->nPixels, dst + row * m_pConfig->nPixels, m_pConfig->nPixels);
+    }
+}
+
+const float* QStreamTab::formLifetime()
+{
+    // Intensity-weighted mean delay of the accumulated frame: sum(tau * I) / sum(I)
+    if (m_lifetimeImage.length() != m_pTempLifetime.length())
+        m_lifetimeImage = np::FloatArray2(m_pConfig->nPixels, 4 * m_pConfig->nLines);
+
+    int n = m_lifetimeImage.length();
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)(4 * m_pConfig->nLines)),
+        [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t i = r.begin(); i != r.end(); ++i)
+        {
+            int offset = (int)i * m_pConfig->nPixels;
+            for (int j = offset; j < offset + m_pConfig->nPixels; j++)
+            {
+                float I = m_pTempLifetimeWeight.raw_ptr()[j];
+                m_lifetimeImage.raw_ptr()[j] = (I > 0) ? m_pTempLifetime.raw_ptr()[j] / I : 0.0f;
+            }
+        }
+    });
+    memset(m_pTempLifetime, 0, sizeof(float) * n);
+    memset(m_pTempLifetimeWeight, 0, sizeof(float) * n);
+
+    return m_lifetimeImage.raw_ptr();
+}
+
+void QStreamTab::formImage(np::FloatArray2& image, float scale, bool capturing, const bool* channels, const float* lifetime)
+{
+    std::unique_lock<std::mutex> lock(m_mtxImageFormation);
+
+    // Formed into the back image of the mailbox, then published to the UI
+    np::FloatArray2& vis_image = m_pVisualizationTab->m_visImageBuffer.getBack();
+    bool correction = m_bFlatFieldCorrection && !capturing;
+    Histogram* hist = (m_pConfig->autoContrast || m_histogram.isEnabled()) ? &m_histogram : nullptr;
+
+    for (int i = 0; i < 4; i++)
+    {
+        float* vis_ptr = &vis_image(0, i * m_pConfig->nLines);
+        float* form_ptr = m_scanCompensation.getBuffer();
+        if (channels && !channels[i])
+        {
+            // Keep the latest image for the channels not formed
+            memcpy(vis_ptr, &m_pVisualizationTab->m_visImageBuffer.getLatest()(0, i * m_pConfig->nLines), sizeof(float) * m_pConfig->imageSize);
+            if (m_bLifetimeRendering)
+                memcpy(&vis_image(0, (4 + i) * m_pConfig->nLines), &m_pVisualizationTab->m_visImageBuffer.getLatest()(0, (4 + i) * m_pConfig->nLines), sizeof(float) * m_pConfig->imageSize);
+            continue;
+        }
+
+        // Averaging (fused with dark-frame & flat-field correction and histogram)
+        if (hist) hist->begin(i, m_pConfig->imageContrastRange[i].min, m_pConfig->imageContrastRange[i].max,
+                              (m_pConfig->saturationLevel[i] > 0) ? m_pConfig->saturationLevel[i] : FLT_MAX);
+        if (correction)
+            m_flatField(&image(0, i * m_pConfig->nLines), scale, (float)m_pConfig->imageAccumulationFrames, form_ptr, i, hist);
+        else if (hist)
+            hist->scale(&image(0, i * m_pConfig->nLines), scale, form_ptr, m_pConfig->nPixels, m_pConfig->nLines);
+        else
+            ippsMulC_32f(&image(0, i * m_pConfig->nLines), scale, form_ptr, m_pConfig->imageSize);
+        if (hist)
+        {
+            hist->end(i);
+            if (m_pConfig->autoContrast)
+                hist->updateRange(i, m_pConfig->autoContrastLow, m_pConfig->autoContrastHigh, m_pConfig->autoContrastSmoothing);
+        }
+
+        if (capturing)
+            m_flatField.accumulate(form_ptr, i, (float)m_pConfig->imageAccumulationFrames);
+
+        // CRS nonlinear scanning compensation (single gather pass into the mailbox image)
+        m_scanCompensation(form_ptr, vis_ptr);
+
+        // Lifetime planes (after the intensity planes, the latest ones are kept if not formed, untouched if not rendered)
+        float* vis_lifetime_ptr = &vis_image(0, (4 + i) * m_pConfig->nLines);
+        if (lifetime)
+            m_scanCompensation(lifetime + i * m_pConfig->imageSize, vis_lifetime_ptr);
+        else if (m_bLifetimeRendering)
+            memcpy(vis_lifetime_ptr, &m_pVisualizationTab->m_visImageBuffer.getLatest()(0, (4 + i) * m_pConfig->nLines), sizeof(float) * m_pConfig->imageSize);
+    }
+
+    // ROI statistics of every formed image (re-formed images of edited windows are not recorded)
+    const float* images[4];
+    for (int i = 0; i < 4; i++)
+        images[i] = &vis_image(0, i * m_pConfig->nLines);
+    m_pVisualizationTab->updateRoiStats(images, channels == nullptr);
+
+    m_pVisualizationTab->publishImage();
+}
+
+void QStreamTab::resetVisualizationBuffers()
+{
+    // Lifetime planes only with lifetime rendering (latched per acquisition, all buffers are returned while stopped)
+    m_bLifetimeRendering = m_pConfig->lifetimeRendering;
+    int planes = m_bLifetimeRendering ? 8 : 4;
+    if (planes == m_nVisualizationPlanes)
+        return;
+
+    m_syncDataVisualization.deallocate_queue_buffer();
+    m_syncDataVisualization.allocate_queue_buffer((m_pConfig->nSegments * m_pConfig->nTimes) / 2 /* raw pulse */
+                                                  + (m_pConfig->nPixels * m_pConfig->nTimes /* width */ * planes /* height (intensity & lifetime) */), PROCESSING_BUFFER_SIZE);
+    m_nVisualizationPlanes = planes;
+}
+
+void QStreamTab::reformImage()
+{
+    // Posted to the re-form worker (pending requests are merged)
+    {
+        std::unique_lock<std::mutex> lock(m_mtxReform);
+        m_bReformRequest = true;
+    }
+    m_cvReform.notify_one();
+}
+
+void QStreamTab::reformCachedImage()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mtxReform);
+        m_cvReform.wait(lock, [&]() { return m_bReformRequest || m_bReformStop; });
+        if (m_bReformStop)
+            return;
+        m_bReformRequest = false;
+    }
+
+    // Re-render the last image with the current channel windows (boxcar channels only)
+    DataProcess *pDataProc = m_pOperationTab->getDataAcq()->getDataProc();
+
+    np::FloatArray2 image0(m_pConfig->imageSize, 4);
+
+    bool channels[4];
+    if (!pDataProc->getCachedIntensity(image0, channels))
+        return;
+
+    // Scan lines into the final rows
+    np::FloatArray2 image(m_pConfig->nPixels, 4 * m_pConfig->nLines);
+    memset(image.raw_ptr(), 0, sizeof(float) * image.length());
+    for (int i = 0; i < 4; i++)
+        addLines(&image0(0, i), 0, m_pConfig->nLines, &image(0, i * m_pConfig->nLines));
+
+    // Cached data is a single frame: scale it as the accumulated image
+    formImage(image, (float)m_pConfig->imageAccumulationFrames, false, channels);
+}
+
 void QStreamTab::onTimerMonitoring()
 {
     if (getOperationTab()->isAcquisitionButtonToggled())
@@ -806,6 +1079,7 @@ void QStreamTab::changeAveragingFrame(const QString &str)
 	}
 
 	m_pConfig->imageAveragingFrames = avg_frame;
+	m_runningAverage.request(avg_frame, m_pConfig->imageAveragingMode);
 
 	m_nAcquiredFrames = 0;
 
@@ -819,6 +1093,14 @@ void QStreamTab::changeAveragingFrame(const QString &str)
     m_pLabel_AcquisitionStatusMsg->setText(str1);
 }
 
+void QStreamTab::changeAveragingMode(int mode)
+{
+	m_pConfig->imageAveragingMode = mode;
+	m_runningAverage.request(m_pConfig->imageAveragingFrames, mode);
+
+	m_nAcquiredFrames = 0;
+}
+
 void QStreamTab::processMessage(QString qmsg, bool is_error)
 {
 	m_pListWidget_MsgWnd->addItem(qmsg);
@@ -849,18 +1131,30 @@ void QStreamTab::changeCRSNonlinearityComp(bool toggled)
         {
             QTextStream in(&file);
 
+            np::FloatArray2 comp_table(m_pConfig->nPixels, 2);
+            for (int i = 0; i < m_pConfig->nPixels; i++)
+            {
+                comp_table(i, 0) = (float)i;
+                comp_table(i, 1) = 1.0f;
+            }
+
             int i = 0;
-            while (!in.atEnd())
+            while (!in.atEnd() && (i < m_pConfig->nPixels))
             {
                 QString line = in.readLine();
                 QStringList comp_idx = line.split('\t');
+                if (comp_idx.size() < 2) continue;
 
-                m_pCRSCompIdx(i, 0) = comp_idx[0].toFloat();
-                m_pCRSCompIdx(i, 1) = comp_idx[1].toFloat();
+                comp_table(i, 0) = comp_idx[0].toFloat();
+                comp_table(i, 1) = comp_idx[1].toFloat();
                 i++;
             }
 
             file.close();
+
+            // Compiled once into the integer index & weight table
+            std::unique_lock<std::mutex> lock(m_mtxImageFormation);
+            m_scanCompensation.setTable(&comp_table(0, 0), &comp_table(0, 1));
         }
         else
         {
@@ -870,12 +1164,65 @@ void QStreamTab::changeCRSNonlinearityComp(bool toggled)
     }
     else
     {
-        for (int i = 0; i < m_pConfig->nPixels; i++)
+        std::unique_lock<std::mutex> lock(m_mtxImageFormation);
+        m_scanCompensation.reset();
+    }
+}
+
+void QStreamTab::changeCrossTalkUnmixing(bool toggled)
+{
+    DataProcess *pDataProc = m_pOperationTab->getDataAcq()->getDataProc();
+
+    // Unmixing matrix is calibrated for normalized intensities (not photon counts)
+    bool photon_counting = false;
+    for (int i = 0; i < 4; i++)
+        photon_counting |= (m_pConfig->channelIntensityMode[i] == INTENSITY_PHOTON_COUNTING);
+    if (toggled && photon_counting)
+    {
+        processMessage("Crosstalk unmixing is not available with photon counting channels.", true);
+        m_pCheckBox_CrossTalkUnmixing->setChecked(false);
+        return;
+    }
+
+    m_pConfig->crossTalkUnmixing = toggled;
+    if (!pDataProc->setUnmixing(m_pConfig->crossTalkMatrix, toggled)) // staged with the matrix
+        m_pCheckBox_CrossTalkUnmixing->setChecked(false);
+}
+
+void QStreamTab::changeFlatFieldCorrection(bool toggled)
+{
+    m_pConfig->flatFieldCorrection = toggled;
+    if (toggled)
+    {
+        // Loaded aside and swapped in between formed images
+        if (!m_flatField.load("dark_frame.bin", "flat_field.bin"))
         {
-            m_pCRSCompIdx(i, 0) = i;
-            m_pCRSCompIdx(i, 1) = 1;
+            m_pCheckBox_FlatFieldCorrection->setChecked(false);
+            processMessage("No dark-frame or flat-field map file! (dark_frame.bin, flat_field.bin)", true);
+            return;
         }
+
+        std::unique_lock<std::mutex> lock(m_mtxImageFormation);
+        m_flatField.swapLoaded();
     }
+    m_bFlatFieldCorrection = toggled;
+}
+
+void QStreamTab::captureDarkFrame()
+{
+    m_flatField.startCapture(FLAT_FIELD_DARK, m_pConfig->flatFieldFrames);
+    processMessage("Capturing dark-frame map... (block the excitation)", false);
+}
+
+void QStreamTab::captureFlatField()
+{
+    m_flatField.startCapture(FLAT_FIELD_FLAT, m_pConfig->flatFieldFrames);
+    processMessage("Capturing flat-field map... (image a uniform sample)", false);
+}
+
+void QStreamTab::changeFlatFieldFrames(const QString &str)
+{
+    m_pConfig->flatFieldFrames = str.toInt();
 }
 
 #ifndef RAW_PULSE_WRITE
@@ -976,6 +1323,30 @@ void QStreamTab::changeStitchingYStep(const QString &str)
     m_pLabel_AcquisitionStatusMsg->setText(str1);
 }
 
+void QStreamTab::createMosaicViewer()
+{
+    if (m_pTileView == nullptr)
+    {
+        QString fileName = QFileDialog::getOpenFileName(nullptr, "Open Mosaic", "", "Tile pyramid (pyramid.ini)");
+        if (fileName.isEmpty())
+            return;
+
+        // Tiles of the pyramid being written are refreshed as they arrive
+        m_pTileView = new QTileView(QFileInfo(fileName).path(), m_pConfig->mosaicCacheSize, this);
+        connect(m_pTileView, SIGNAL(finished(int)), this, SLOT(deleteMosaicViewer()));
+        connect(m_pOperationTab->getMemBuff(), SIGNAL(wroteMosaicTile(int, int)), m_pTileView, SLOT(invalidate(int, int)));
+        m_pTileView->show();
+    }
+    m_pTileView->raise();
+    m_pTileView->activateWindow();
+}
+
+void QStreamTab::deleteMosaicViewer()
+{
+    m_pTileView->deleteLater();
+    m_pTileView = nullptr;
+}
+
 //void QStreamTab::changeStitchingMisSyncPos(const QString &str)
 //{
 //    m_pConfig->imageStichingMisSyncPos = str.toInt();
@@ -9,15 +9,24 @@
 
 #include <Common/array.h>
 #include <Common/SyncObject.h>
+#include <Common/FlatField.h>
+#include <Common/RunningAverage.h>
+#include <Common/ScanCompensation.h>
+#include <Common/PulseMonitor.h>
+#include <Common/FocusMetric.h>
 
 #include <iostream>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 
 class MainWindow;
 class QOperationTab;
 class QDeviceControlTab;
 class QVisualizationTab;
+class QTileView;
 
 class ThreadManager;
 class DataProcess;
@@ -42,8 +51,11 @@ public:
     inline QDeviceControlTab* getDeviceControlTab() const { return m_pDeviceControlTab; }
 	inline QVisualizationTab* getVisualizationTab() const { return m_pVisualizationTab; }
     inline QCheckBox* getCRSNonlinComp() const { return m_pCheckBox_CRSNonlinearityComp; }
+    inline QCheckBox* getCrossTalkUnmixing() const { return m_pCheckBox_CrossTalkUnmixing; }
+    inline bool isLifetimeRendering() const { return m_bLifetimeRendering; }
 #ifndef RAW_PULSE_WRITE
     inline QCheckBox* getImageStitchingCheckBox() const { return m_pCheckBox_StitchingMode; }
+    inline QTileView* getTileView() const { return m_pTileView; }
 #endif
 	
 public:
@@ -51,6 +63,8 @@ public:
 	void setAveragingWidgets(bool enabled);
 	void resetImagingMode();
     void stageMoving();
+    void reformImage();
+    void resetVisualizationBuffers();
 
 private:		
 // Set thread callback objects
@@ -58,18 +72,36 @@ private:
     void setDataProcessingCallback();
     void setVisualizationCallback();
 
+// Line accumulation into the final rows (galvo shift, flyback rows skipped)
+    void addLines(const float* src, int first_line, int n_lines, float* dst);
+
+// Image formation (averaging, correction & scanning compensation)
+    void formImage(np::FloatArray2& image, float scale, bool capturing, const bool* channels = nullptr, const float* lifetime = nullptr);
+// Intensity-weighted lifetime of the accumulated frame (clears the lifetime accumulation)
+    const float* formLifetime();
+// Re-formation of the cached frame with the current channel windows (re-form worker)
+    void reformCachedImage();
+
 private slots:
     void onTimerMonitoring();
 	void changeAccumulationFrame(const QString &);
 	void changeAveragingFrame(const QString &);
+	void changeAveragingMode(int);
     void processMessage(QString, bool);
 	void setSyncComp(int);
     void changeCRSNonlinearityComp(bool);    
+    void changeCrossTalkUnmixing(bool);
+    void changeFlatFieldCorrection(bool);
+    void captureDarkFrame();
+    void captureFlatField();
+    void changeFlatFieldFrames(const QString &);
 #ifndef RAW_PULSE_WRITE
     void enableStitchingMode(bool);
     void changeStitchingXStep(const QString &);
     void changeStitchingYStep(const QString &);
 //    void changeStitchingMisSyncPos(const QString &);
+    void createMosaicViewer();
+    void deleteMosaicViewer();
 #endif
 
 signals:
@@ -91,12 +123,40 @@ public:
 	// Image buffer
 	np::FloatArray2 m_pTempImage0;
 	np::FloatArray2 m_pTempImage; 
+	np::FloatArray2 m_pTempLifetime; // tau * intensity
+	np::FloatArray2 m_pTempLifetimeWeight; // intensity (thresholded at 0 as in tau * intensity)
+	np::FloatArray2 m_lifetimeImage;
+
+	// Lifetime rendering of the current acquisition (lifetime planes in the visualization buffers)
+	std::atomic<bool> m_bLifetimeRendering;
+	int m_nVisualizationPlanes;
 
 	// Image acquisition
     int m_nAcquiredFrames;
 
-    // CRS nonlinearity compensation idx
-    np::FloatArray2 m_pCRSCompIdx;
+    // CRS nonlinearity compensation (compiled idx & weight table)
+    ScanCompensation m_scanCompensation;
+
+    // Running average (exponential & sliding-window display modes)
+    RunningAverage m_runningAverage;
+
+    // Dark-frame & flat-field correction maps
+    FlatField m_flatField;
+    std::atomic<bool> m_bFlatFieldCorrection; // set once the loaded maps are in use
+
+    // Streaming intensity histograms (auto-contrast)
+    Histogram m_histogram;
+
+    // Selected A-line pulse monitor (pulse calibration)
+    PulseMonitor m_pulseMonitor;
+
+    // Sharpness of each formed image (live focus metric & autofocus sweep samples)
+    FocusMetric m_focusMetric;
+    FocusSweep m_focusSweep;
+    std::atomic<float> m_focusValue[4];
+
+    // Image formation lock (visualization thread & re-rendering)
+    std::mutex m_mtxImageFormation;
 
     // Stitching flag
     bool m_bIsStageTransition;
@@ -107,6 +167,13 @@ public:
     ThreadManager* m_pThreadDataProcess;
     ThreadManager* m_pThreadVisualization;
 
+private:
+    // Re-form worker: requests of edited channel windows are coalesced (latest windows only)
+    ThreadManager* m_pThreadReform;
+    std::mutex m_mtxReform;
+    std::condition_variable m_cvReform;
+    bool m_bReformRequest, m_bReformStop;
+
 private:
     // Thread synchronization objects
     SyncObject<uint16_t> m_syncDataProcessing;
@@ -127,6 +194,7 @@ private:
 	// Image averaging & accumulation mode 
 	QLabel *m_pLabel_Averaging;
 	QLineEdit *m_pLineEdit_Averaging;
+	QComboBox *m_pComboBox_AveragingMode;
 	QLabel *m_pLabel_Accumulation;
 	QLineEdit *m_pLineEdit_Accumulation;
 	
@@ -139,6 +207,15 @@ private:
     // CRS nonlinearity compensation
     QCheckBox *m_pCheckBox_CRSNonlinearityComp;
 
+    // Spectral crosstalk unmixing
+    QCheckBox *m_pCheckBox_CrossTalkUnmixing;
+
+    // Dark-frame & flat-field correction
+    QCheckBox *m_pCheckBox_FlatFieldCorrection;
+    QPushButton *m_pPushButton_CaptureDark;
+    QPushButton *m_pPushButton_CaptureFlat;
+    QLineEdit *m_pLineEdit_FlatFieldFrames;
+
 #ifndef RAW_PULSE_WRITE
     // Stitching mode
     QCheckBox *m_pCheckBox_StitchingMode;
@@ -146,6 +223,8 @@ private:
     QLineEdit *m_pLineEdit_YStep;
     QLabel *m_pLabel_XStep;
     QLabel *m_pLabel_YStep;
+    QPushButton *m_pPushButton_MosaicViewer;
+    QTileView *m_pTileView;
 //    QLineEdit *m_pLineEdit_MisSyncPos;
 //    QLabel *m_pLabel_MisSyncPos;
 #endif
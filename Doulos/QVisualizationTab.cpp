@@ -7,9 +7,11 @@
 #include <Doulos/QDeviceControlTab.h>
 
 #include <Doulos/Dialog/PulseCalibDlg.h>
+#include <Doulos/Dialog/HistogramDlg.h>
 #include <Doulos/Viewer/QImageView.h>
 
 #include <DataAcquisition/DataAcquisition.h>
+#include <DataAcquisition/ThreadManager.h>
 //#include <DataAcquisition/DataProcess/DataProcess.h>
 
 //#include <Common/basic_functions.h>
@@ -31,18 +33,15 @@ static const char* mode_name[4] = { "SHG", "TPFE", "CARS", "RCM" };
 
 
 QVisualizationTab::QVisualizationTab(QWidget *parent) :
-    QDialog(parent), m_pStreamTab(nullptr), m_pMedfilt(nullptr)
+    QDialog(parent), m_pStreamTab(nullptr), m_pMedfilt(nullptr), m_pHistogramDlg(nullptr)
 {
-	// Set image objects as nullptr
-	for (int i = 0; i < 4; i++) m_pImgObj[i] = nullptr;
-
     // Set configuration objects	
 	m_pStreamTab = (QStreamTab*)parent;
 	m_pConfig = m_pStreamTab->getMainWnd()->m_pConfiguration;
 	
     // Create image view
 	for (int i = 0; i < 4; i++)
-        m_pImageView_Image[i] = new QImageView(ColorTable::colortable(color_table_index[m_pConfig->channelImageMode[i]]), m_pConfig->nPixels, m_pConfig->nLines);
+        m_pImageView_Image[i] = new QImageView(ColorTable::colortable(color_table_index[m_pConfig->channelImageMode[i]]), m_pConfig->nPixels, m_pConfig->nLines, true);
     m_pImageView_Image[4] = new QImageView(ColorTable::gray, m_pConfig->nPixels, m_pConfig->nLines, true);
 
     for (int i = 0; i < 5; i++)
@@ -51,6 +50,28 @@ QVisualizationTab::QVisualizationTab(QWidget *parent) :
 		m_pImageView_Image[i]->setSquare(true);
 		m_pImageView_Image[i]->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
 		m_pImageView_Image[i]->setHorizontalLine(1, m_pConfig->nLines - GALVO_FLYING_BACK);
+		m_pImageView_Image[i]->setZoomEnable(true);
+		m_pImageView_Image[i]->setRoiChangedCallback([&, i]() {
+			// Same zoom region in all views
+			for (int j = 0; j < 5; j++)
+				m_pImageView_Image[j]->getRender()->m_zoomRoi = m_pImageView_Image[i]->getRender()->m_zoomRoi;
+			emit drawImage();
+		});
+		m_pImageView_Image[i]->setMeasureChangedCallback([&, i]() {
+			// Same measurement region in all views
+			int* pts = m_pImageView_Image[i]->getRender()->m_measurePoints;
+			for (int j = 0; j < 5; j++)
+			{
+				memcpy(m_pImageView_Image[j]->getRender()->m_measurePoints, pts, sizeof(int) * 4);
+				m_pImageView_Image[j]->getRender()->update();
+			}
+			{
+				std::unique_lock<std::mutex> lock(m_mtxRoi);
+				m_roiStats.setPoints(pts[0], pts[1], pts[2], pts[3]);
+			}
+			m_bRoiChanged = true;
+			emit drawImage(); // statistics of the displayed image by the render worker
+		});
 		m_pImageView_Image[i]->setClickedMouseCallback([&](int x, int y) {
 			for (int j = 0; j < 4; j++)
 			{
@@ -60,6 +81,7 @@ QVisualizationTab::QVisualizationTab(QWidget *parent) :
 			}
 		});			
 		m_pImageView_Image[i]->setMovedMouseCallback([&, i](QPoint& p) { 
+			std::unique_lock<std::mutex> lock(m_mtxFront);
 			m_pStreamTab->getMainWnd()->m_pStatusLabel_ImagePos->setText(QString("[%1] (%2, %3) | (%4)")
                 .arg(mode_name[m_pConfig->channelImageMode[i]]).arg(p.x(), 4).arg(p.y(), 4)
                 .arg(m_vecVisImage.at(m_pConfig->channelImageMode[i]).at(p.x(), p.y()), 4, 'f', 3)); });
@@ -67,21 +89,42 @@ QVisualizationTab::QVisualizationTab(QWidget *parent) :
     m_pImageView_Image[4]->hide();
 	
 	// Create visualization buffers
-	for (int i = 0; i < 4; i++)
+	for (int i = 0; i < 3; i++)
 	{
-		np::FloatArray2 image = np::FloatArray2(m_pConfig->nPixels, m_pConfig->nLines);
-		memset(image.raw_ptr(), 0, sizeof(float) * image.length());
-		m_vecVisImage.push_back(image);
+		m_visImageBuffer.buffer[i] = np::FloatArray2(m_pConfig->nPixels, 8 * m_pConfig->nLines); // intensity & lifetime
+		memset(m_visImageBuffer.buffer[i].raw_ptr(), 0, sizeof(float) * m_visImageBuffer.buffer[i].length());
 	}
+	m_bDrawPending = false;
+	m_nPublishedFrames = 0;
+
+	np::FloatArray2& front = m_visImageBuffer.getFront();
+	for (int i = 0; i < 4; i++)
+		m_vecVisImage.push_back(np::FloatArray2(&front(0, i * m_pConfig->nLines), m_pConfig->nPixels, m_pConfig->nLines));
+	for (int i = 0; i < 4; i++)
+		m_vecLifetimeImage.push_back(np::FloatArray2(&front(0, (4 + i) * m_pConfig->nLines), m_pConfig->nPixels, m_pConfig->nLines));
 
-	// Create image visualization buffers
-	ColorTable temp_ctable;
 	for (int i = 0; i < 4; i++)
-        m_pImgObj[i] = new ImageObject(m_pConfig->nPixels, m_pConfig->nLines, temp_ctable.m_colorTableVector.at(color_table_index[m_pConfig->channelImageMode[i]]));
-    m_pImgObj[4] = new ImageObject(m_pConfig->nPixels, m_pConfig->nLines, temp_ctable.m_colorTableVector.at(0));
+		m_vecFiltImage.push_back(np::FloatArray2(m_pConfig->nPixels, m_pConfig->nLines));
 
 	// Create med filt
-	m_pMedfilt = new medfilt(m_pConfig->nPixels, m_pConfig->nLines, 3, 3);
+	m_pMedfilt = new medfilt(m_pConfig->nPixels, m_pConfig->nLines, m_pConfig->medianFilterSize);
+
+	// Display-rate timer
+	m_pTimer_Display = new QTimer(this);
+	m_pTimer_Display->setSingleShot(true);
+	m_displayClock.start();
+	m_lastDisplayTime = m_lastReportTime = 0;
+	m_nDisplayedFrames = m_nRenderedViews = 0;
+	m_renderNsecs = m_uiNsecs = m_renderFrameNsecs = 0;
+	m_nRenderViews = 0;
+	m_viewRenderTime = 0.0;
+
+	// ROI statistics
+	m_roiProfile = np::FloatArray2(m_pConfig->nPixels + m_pConfig->nLines, 4);
+	m_bRoiRecording = false;
+	m_bRoiChanged = false;
+	m_nRoiFrames = 0;
+	m_nRoiProfileLength = 0;
 
     // Create data visualization option tab
     createDataVisualizationOptionTab();
@@ -125,18 +168,37 @@ QVisualizationTab::QVisualizationTab(QWidget *parent) :
 
     // Connect signal and slot
     connect(this, SIGNAL(drawImage()), this, SLOT(visualizeImage()));
-    connect(this, SIGNAL(plotCh1Image(uint8_t*)), m_pImageView_Image[0], SLOT(drawImage(uint8_t*)));
-    connect(this, SIGNAL(plotCh2Image(uint8_t*)), m_pImageView_Image[1], SLOT(drawImage(uint8_t*)));
-    connect(this, SIGNAL(plotCh3Image(uint8_t*)), m_pImageView_Image[2], SLOT(drawImage(uint8_t*)));
-    connect(this, SIGNAL(plotCh4Image(uint8_t*)), m_pImageView_Image[3], SLOT(drawImage(uint8_t*)));
+    connect(m_pTimer_Display, SIGNAL(timeout()), this, SLOT(visualizeImage()));
+    connect(this, SIGNAL(plotCh1Image(uint8_t*)), m_pImageView_Image[0], SLOT(drawRgbImage(uint8_t*)));
+    connect(this, SIGNAL(plotCh2Image(uint8_t*)), m_pImageView_Image[1], SLOT(drawRgbImage(uint8_t*)));
+    connect(this, SIGNAL(plotCh3Image(uint8_t*)), m_pImageView_Image[2], SLOT(drawRgbImage(uint8_t*)));
+    connect(this, SIGNAL(plotCh4Image(uint8_t*)), m_pImageView_Image[3], SLOT(drawRgbImage(uint8_t*)));
     connect(this, SIGNAL(plotRGBImage(uint8_t*)), m_pImageView_Image[4], SLOT(drawRgbImage(uint8_t*)));
+    connect(this, SIGNAL(renderFinished()), this, SLOT(drawRenderedImages()), Qt::QueuedConnection);
+
+    // Render worker (the UI thread only swaps & blits the finished buffers)
+    for (int i = 0; i < 5; i++)
+        m_renderTargets[i].buffer = nullptr;
+    m_bRenderRequest = m_bRenderStop = false;
+    m_bRenderBusy = false;
+
+    m_pThreadRender = new ThreadManager("Render process");
+    m_pThreadRender->DidAcquireData += [&](int) { renderFrame(); };
+    m_pThreadRender->DidStopData += [&]() {
+        {
+            std::unique_lock<std::mutex> lock(m_mtxRender);
+            m_bRenderStop = true;
+        }
+        m_cvRender.notify_one();
+        m_pThreadRender->_running = false;
+    };
+    m_pThreadRender->startThreading();
 }
 
 QVisualizationTab::~QVisualizationTab()
 {
-	for (int i = 0; i < 4; i++)
-	    if (m_pImgObj[i]) delete m_pImgObj[i];
-	
+    m_pThreadRender->stopThreading();
+    delete m_pThreadRender;
     if (m_pMedfilt) delete m_pMedfilt;
 }
 
@@ -162,6 +224,50 @@ void QVisualizationTab::createDataVisualizationOptionTab()
     m_pCheckBox_RGBImage = new QCheckBox(this);
     m_pCheckBox_RGBImage->setText("RGB Image   ");
     m_pCheckBox_RGBImage->setDisabled(true);
+
+    // Create widgets for median filter
+    m_pLabel_MedianFilter = new QLabel("Median Filter ", this);
+    m_pComboBox_MedianFilter = new QComboBox(this);
+    m_pComboBox_MedianFilter->addItem("Off");
+    m_pComboBox_MedianFilter->addItem("3x3");
+    m_pComboBox_MedianFilter->addItem("5x5");
+    m_pComboBox_MedianFilter->setCurrentIndex((m_pConfig->medianFilterSize == 5) ? 2 : ((m_pConfig->medianFilterSize == 3) ? 1 : 0));
+    m_pComboBox_MedianFilter->setFixedWidth(50);
+
+    // Create widgets for display rate
+    m_pLabel_DisplayRate = new QLabel("Display Rate (Hz) ", this);
+    m_pLineEdit_DisplayRate = new QLineEdit(this);
+    m_pLineEdit_DisplayRate->setFixedWidth(35);
+    m_pLineEdit_DisplayRate->setText(QString::number(m_pConfig->displayRate));
+    m_pLineEdit_DisplayRate->setAlignment(Qt::AlignCenter);
+
+    // Create widgets for intensity-weighted lifetime rendering
+    m_pCheckBox_LifetimeRendering = new QCheckBox(this);
+    m_pCheckBox_LifetimeRendering->setText("Lifetime (HSV)  ");
+    m_pCheckBox_LifetimeRendering->setChecked(m_pConfig->lifetimeRendering);
+    m_pCheckBox_LifetimeRendering->setToolTip("Mean delay (hue) weighted by intensity (brightness)");
+
+    m_pLineEdit_LifetimeMin = new QLineEdit(this);
+    m_pLineEdit_LifetimeMin->setFixedWidth(35);
+    m_pLineEdit_LifetimeMin->setText(QString::number(m_pConfig->lifetimeRange.min, 'f', 1));
+    m_pLineEdit_LifetimeMin->setAlignment(Qt::AlignCenter);
+    m_pLineEdit_LifetimeMax = new QLineEdit(this);
+    m_pLineEdit_LifetimeMax->setFixedWidth(35);
+    m_pLineEdit_LifetimeMax->setText(QString::number(m_pConfig->lifetimeRange.max, 'f', 1));
+    m_pLineEdit_LifetimeMax->setAlignment(Qt::AlignCenter);
+    m_pLabel_Lifetime = new QLabel("nsec", this);
+
+    // Create widgets for live focus metric
+    m_pCheckBox_FocusMetric = new QCheckBox(this);
+    m_pCheckBox_FocusMetric->setText("Focus Metric  ");
+    m_pCheckBox_FocusMetric->setChecked(m_pConfig->focusMetric);
+    m_pComboBox_FocusMetric = new QComboBox(this);
+    m_pComboBox_FocusMetric->addItem("Laplacian");
+    m_pComboBox_FocusMetric->addItem("Gradient");
+    m_pComboBox_FocusMetric->setCurrentIndex(m_pConfig->focusMetricMode);
+    m_pComboBox_FocusMetric->setToolTip("Variance of Laplacian or normalized gradient energy");
+    m_pLabel_FocusMetric = new QLabel(this);
+    m_pLabel_FocusMetric->setVisible(m_pConfig->focusMetric);
 	
     // Create line edit widgets for image contrast adjustment
 	for (int i = 0; i < 4; i++)
@@ -174,8 +280,68 @@ void QVisualizationTab::createDataVisualizationOptionTab()
 		m_pLineEdit_ContrastMin[i]->setFixedWidth(35);
         m_pLineEdit_ContrastMin[i]->setText(QString::number(m_pConfig->imageContrastRange[i].min, 'f', 1));
 		m_pLineEdit_ContrastMin[i]->setAlignment(Qt::AlignCenter);
+
+        m_pCheckBox_ClippingOverlay[i] = new QCheckBox(this);
+        m_pCheckBox_ClippingOverlay[i]->setChecked(m_pConfig->clippingOverlay[i]);
+        m_pCheckBox_ClippingOverlay[i]->setToolTip("Overlay of the clipped (blue: below, red: above the range) and saturated (magenta) pixels");
 	}
 
+    // Create widgets for auto contrast
+    m_pCheckBox_AutoContrast = new QCheckBox(this);
+    m_pCheckBox_AutoContrast->setText("Auto Contrast  ");
+    m_pCheckBox_AutoContrast->setChecked(m_pConfig->autoContrast);
+
+    m_pLineEdit_AutoContrastLow = new QLineEdit(this);
+    m_pLineEdit_AutoContrastLow->setFixedWidth(35);
+    m_pLineEdit_AutoContrastLow->setText(QString::number(m_pConfig->autoContrastLow, 'f', 1));
+    m_pLineEdit_AutoContrastLow->setAlignment(Qt::AlignCenter);
+    m_pLineEdit_AutoContrastHigh = new QLineEdit(this);
+    m_pLineEdit_AutoContrastHigh->setFixedWidth(35);
+    m_pLineEdit_AutoContrastHigh->setText(QString::number(m_pConfig->autoContrastHigh, 'f', 1));
+    m_pLineEdit_AutoContrastHigh->setAlignment(Qt::AlignCenter);
+    m_pLabel_AutoContrast = new QLabel("%", this);
+
+    m_pPushButton_Histogram = new QPushButton(this);
+    m_pPushButton_Histogram->setText("Histogram...");
+    for (int i = 0; i < 4; i++)
+    {
+        m_pLineEdit_ContrastMax[i]->setDisabled(m_pConfig->autoContrast);
+        m_pLineEdit_ContrastMin[i]->setDisabled(m_pConfig->autoContrast);
+    }
+
+    // Create widgets for ROI statistics & line profiles
+    m_pLabel_RoiMode = new QLabel("ROI Statistics ", this);
+    m_pComboBox_RoiMode = new QComboBox(this);
+    m_pComboBox_RoiMode->addItem("Off");
+    m_pComboBox_RoiMode->addItem("Rect");
+    m_pComboBox_RoiMode->addItem("Line");
+    m_pComboBox_RoiMode->setFixedWidth(50);
+    m_pComboBox_RoiMode->setToolTip("Drag on the image to set the region");
+
+    m_pToggleButton_RoiRecord = new QPushButton(this);
+    m_pToggleButton_RoiRecord->setText("Record");
+    m_pToggleButton_RoiRecord->setCheckable(true);
+    m_pToggleButton_RoiRecord->setFixedWidth(60);
+    m_pToggleButton_RoiRecord->setDisabled(true);
+
+    m_pPushButton_RoiExport = new QPushButton(this);
+    m_pPushButton_RoiExport->setText("Export");
+    m_pPushButton_RoiExport->setFixedWidth(60);
+    m_pPushButton_RoiExport->setDisabled(true);
+
+    m_pLabel_RoiStats = new QLabel(this);
+    m_pLabel_RoiStats->setFont(QFont("Courier New", 8));
+    m_pLabel_RoiStats->hide();
+
+    m_pScope_RoiProfile = new QScope({ 0, (double)m_pConfig->nPixels }, { 0, 1 }, 2, 2, 1, 1, 0, 0, "", "");
+    m_pScope_RoiProfile->setFixedHeight(100);
+    m_pScope_RoiProfile->setTraces(4);
+    m_pScope_RoiProfile->setTraceColor(0, QColor(0x5d9bff));
+    m_pScope_RoiProfile->setTraceColor(1, QColor(0x5dff7a));
+    m_pScope_RoiProfile->setTraceColor(2, QColor(0xff5d5d));
+    m_pScope_RoiProfile->setTraceColor(3, QColor(0xd0d0d0));
+    m_pScope_RoiProfile->hide();
+
     // Create color bar for data visualization
     uint8_t color[256];
     for (int i = 0; i < 256; i++)
@@ -211,10 +377,57 @@ void QVisualizationTab::createDataVisualizationOptionTab()
 		pGridLayout_ContrastAdjustment->addWidget(m_pLineEdit_ContrastMin[i], i, 1);
 		pGridLayout_ContrastAdjustment->addWidget(m_pImageView_ModeColorbar[i], i, 2);
 		pGridLayout_ContrastAdjustment->addWidget(m_pLineEdit_ContrastMax[i], i, 3);
+        pGridLayout_ContrastAdjustment->addWidget(m_pCheckBox_ClippingOverlay[i], i, 4);
 	}
 
+    QHBoxLayout *pHBoxLayout_AutoContrast = new QHBoxLayout;
+    pHBoxLayout_AutoContrast->addWidget(m_pPushButton_Histogram);
+    pHBoxLayout_AutoContrast->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed));
+    pHBoxLayout_AutoContrast->addWidget(m_pCheckBox_AutoContrast);
+    pHBoxLayout_AutoContrast->addWidget(m_pLineEdit_AutoContrastLow);
+    pHBoxLayout_AutoContrast->addWidget(m_pLineEdit_AutoContrastHigh);
+    pHBoxLayout_AutoContrast->addWidget(m_pLabel_AutoContrast);
+
+    QHBoxLayout *pHBoxLayout_DisplayRate = new QHBoxLayout;
+    pHBoxLayout_DisplayRate->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed));
+    pHBoxLayout_DisplayRate->addWidget(m_pLabel_MedianFilter);
+    pHBoxLayout_DisplayRate->addWidget(m_pComboBox_MedianFilter);
+    pHBoxLayout_DisplayRate->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed));
+    pHBoxLayout_DisplayRate->addWidget(m_pLabel_DisplayRate);
+    pHBoxLayout_DisplayRate->addWidget(m_pLineEdit_DisplayRate);
+
 	pGridLayout_DataVisualization->addItem(pHBoxLayout_SingleModeVisualization, 0, 0);
 	pGridLayout_DataVisualization->addItem(pGridLayout_ContrastAdjustment, 1, 0);
+	pGridLayout_DataVisualization->addItem(pHBoxLayout_AutoContrast, 2, 0);
+	pGridLayout_DataVisualization->addItem(pHBoxLayout_DisplayRate, 3, 0);
+
+    QHBoxLayout *pHBoxLayout_Lifetime = new QHBoxLayout;
+    pHBoxLayout_Lifetime->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed));
+    pHBoxLayout_Lifetime->addWidget(m_pCheckBox_LifetimeRendering);
+    pHBoxLayout_Lifetime->addWidget(m_pLineEdit_LifetimeMin);
+    pHBoxLayout_Lifetime->addWidget(m_pLineEdit_LifetimeMax);
+    pHBoxLayout_Lifetime->addWidget(m_pLabel_Lifetime);
+
+	pGridLayout_DataVisualization->addItem(pHBoxLayout_Lifetime, 4, 0);
+
+    QHBoxLayout *pHBoxLayout_FocusMetric = new QHBoxLayout;
+    pHBoxLayout_FocusMetric->addWidget(m_pLabel_FocusMetric);
+    pHBoxLayout_FocusMetric->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed));
+    pHBoxLayout_FocusMetric->addWidget(m_pCheckBox_FocusMetric);
+    pHBoxLayout_FocusMetric->addWidget(m_pComboBox_FocusMetric);
+
+	pGridLayout_DataVisualization->addItem(pHBoxLayout_FocusMetric, 5, 0);
+
+    QHBoxLayout *pHBoxLayout_RoiStats = new QHBoxLayout;
+    pHBoxLayout_RoiStats->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed));
+    pHBoxLayout_RoiStats->addWidget(m_pLabel_RoiMode);
+    pHBoxLayout_RoiStats->addWidget(m_pComboBox_RoiMode);
+    pHBoxLayout_RoiStats->addWidget(m_pToggleButton_RoiRecord);
+    pHBoxLayout_RoiStats->addWidget(m_pPushButton_RoiExport);
+
+	pGridLayout_DataVisualization->addItem(pHBoxLayout_RoiStats, 6, 0);
+	pGridLayout_DataVisualization->addWidget(m_pLabel_RoiStats, 7, 0);
+	pGridLayout_DataVisualization->addWidget(m_pScope_RoiProfile, 8, 0);
 
     m_pGroupBox_DataVisualization->setLayout(pGridLayout_DataVisualization);
 
@@ -230,7 +443,22 @@ void QVisualizationTab::createDataVisualizationOptionTab()
     {
 		connect(m_pLineEdit_ContrastMax[i], SIGNAL(textEdited(const QString &)), this, SLOT(adjustImageContrast()));
 		connect(m_pLineEdit_ContrastMin[i], SIGNAL(textEdited(const QString &)), this, SLOT(adjustImageContrast()));
+        connect(m_pCheckBox_ClippingOverlay[i], SIGNAL(toggled(bool)), this, SLOT(changeClippingOverlay(bool)));
 	}
+    connect(m_pCheckBox_AutoContrast, SIGNAL(toggled(bool)), this, SLOT(changeAutoContrast(bool)));
+    connect(m_pPushButton_Histogram, SIGNAL(clicked(bool)), this, SLOT(createHistogramDlg()));
+    connect(m_pComboBox_RoiMode, SIGNAL(currentIndexChanged(int)), this, SLOT(changeRoiMode(int)));
+    connect(m_pToggleButton_RoiRecord, SIGNAL(toggled(bool)), this, SLOT(recordRoiStats(bool)));
+    connect(m_pPushButton_RoiExport, SIGNAL(clicked(bool)), this, SLOT(exportRoiStats()));
+    connect(m_pLineEdit_AutoContrastLow, SIGNAL(textEdited(const QString &)), this, SLOT(changeAutoContrastPercentile(const QString &)));
+    connect(m_pLineEdit_AutoContrastHigh, SIGNAL(textEdited(const QString &)), this, SLOT(changeAutoContrastPercentile(const QString &)));
+    connect(m_pComboBox_MedianFilter, SIGNAL(currentIndexChanged(int)), this, SLOT(changeMedianFilter(int)));
+    connect(m_pLineEdit_DisplayRate, SIGNAL(textChanged(const QString &)), this, SLOT(changeDisplayRate(const QString &)));
+    connect(m_pCheckBox_LifetimeRendering, SIGNAL(toggled(bool)), this, SLOT(changeLifetimeRendering(bool)));
+    connect(m_pLineEdit_LifetimeMin, SIGNAL(textEdited(const QString &)), this, SLOT(adjustLifetimeRange()));
+    connect(m_pLineEdit_LifetimeMax, SIGNAL(textEdited(const QString &)), this, SLOT(adjustLifetimeRange()));
+    connect(m_pCheckBox_FocusMetric, SIGNAL(toggled(bool)), this, SLOT(changeFocusMetric(bool)));
+    connect(m_pComboBox_FocusMetric, SIGNAL(currentIndexChanged(int)), this, SLOT(changeFocusMetricMode(int)));
 }
 
 void QVisualizationTab::setImgViewVisPixelPos(bool vis)
@@ -256,89 +484,268 @@ void QVisualizationTab::setRelevantWidgets(bool enabled)
     for (int i = 0; i < 4; i++)
     {
         m_pComboBox_ModeName[i]->setEnabled(enabled);
-        m_pLineEdit_ContrastMax[i]->setEnabled(enabled);
-        m_pLineEdit_ContrastMin[i]->setEnabled(enabled);
+        m_pLineEdit_ContrastMax[i]->setEnabled(enabled && !m_pConfig->autoContrast);
+        m_pLineEdit_ContrastMin[i]->setEnabled(enabled && !m_pConfig->autoContrast);
         m_pImageView_ModeColorbar[i]->setEnabled(enabled);
     }
 }
 
 
+void QVisualizationTab::publishImage()
+{
+    // Called by the producer after forming the back image: the UI only draws the latest one
+    m_visImageBuffer.publish();
+    m_nPublishedFrames++;
+    if (!m_bDrawPending.exchange(true))
+        emit drawImage();
+}
+
 void QVisualizationTab::visualizeImage()
 {
-    IppiSize roi_image = { m_pConfig->nPixels, m_pConfig->nLines };
+    // Display-rate throttling (deferred to the next display period, the draw stays pending meanwhile)
+    qint64 interval = 1000 / qMax(m_pConfig->displayRate, 1);
+    qint64 elapsed = m_displayClock.elapsed() - m_lastDisplayTime;
+    if (elapsed < interval)
+    {
+        if (!m_pTimer_Display->isActive())
+            m_pTimer_Display->start(interval - elapsed);
+        return;
+    }
+
+    // One frame in flight: requested again when the render worker has finished
+    if (m_bRenderBusy)
+    {
+        m_bDrawPending = true;
+        return;
+    }
+    m_lastDisplayTime = m_displayClock.elapsed();
+    m_bDrawPending = false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Auto contrast (smoothed percentiles of the streaming histograms)
+    if (m_pConfig->autoContrast)
+    {
+        Histogram& hist = m_pStreamTab->m_histogram;
+        for (int i = 0; i < 4; i++)
+        {
+            float min = hist.range_min[i], max = hist.range_max[i];
+            if (max <= min) continue;
+
+            m_pConfig->imageContrastRange[i].min = min;
+            m_pConfig->imageContrastRange[i].max = max;
+            m_pLineEdit_ContrastMin[i]->setText(QString::number(min, 'f', 1));
+            m_pLineEdit_ContrastMax[i]->setText(QString::number(max, 'f', 1));
+        }
+    }
+
+    // Render targets: back images of the visible viewers (single-mode, 4-channel or RGB; nothing while minimized),
+    // not touched by the UI thread until they are swapped in
+    for (int i = 0; i < 5; i++)
+    {
+        RenderTarget& target = m_renderTargets[i];
+        target.buffer = (m_pImageView_Image[i]->isVisible() && !window()->isMinimized()) ? m_pImageView_Image[i]->getRenderBuffer() : nullptr;
+        if (!target.buffer) continue;
+
+        target.roi = m_pImageView_Image[i]->getRenderRoi();
+        target.size = m_pImageView_Image[i]->getRenderSize();
+        target.decimation = m_pImageView_Image[i]->getDecimation();
+    }
+
+    // Hand over to the render worker
+    {
+        std::unique_lock<std::mutex> lock(m_mtxRender);
+        m_bRenderBusy = true;
+        m_bRenderRequest = true;
+    }
+    m_cvRender.notify_one();
+
+    m_uiNsecs += timer.nsecsElapsed();
+}
+
+void QVisualizationTab::renderFrame()
+{
+    // Render worker: all pixel work of a display frame (median filter, scaling, colortable & blending)
+    {
+        std::unique_lock<std::mutex> lock(m_mtxRender);
+        m_cvRender.wait(lock, [&]() { return m_bRenderRequest || m_bRenderStop; });
+        if (m_bRenderStop)
+            return;
+        m_bRenderRequest = false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
 
-    // Image Scaling
+    // Take the latest published image
+    if (m_visImageBuffer.update())
+    {
+        std::unique_lock<std::mutex> lock(m_mtxFront);
+
+        np::FloatArray2& front = m_visImageBuffer.getFront();
+        for (int i = 0; i < 4; i++)
+        {
+            m_vecVisImage.at(i) = np::FloatArray2(&front(0, i * m_pConfig->nLines), m_pConfig->nPixels, m_pConfig->nLines);
+            m_vecLifetimeImage.at(i) = np::FloatArray2(&front(0, (4 + i) * m_pConfig->nLines), m_pConfig->nPixels, m_pConfig->nLines);
+        }
+    }
+
+    // ROI statistics are computed per formed image, only an edited ROI is updated here (e.g. acquisition stopped)
+    if (m_bRoiChanged.exchange(false))
+    {
+        const float* images[4];
+        for (int i = 0; i < 4; i++)
+            images[i] = m_vecVisImage.at(i).raw_ptr();
+        updateRoiStats(images, false);
+    }
+
+    bool visible[5];
+    for (int i = 0; i < 5; i++)
+        visible[i] = m_renderTargets[i].buffer != nullptr;
+
+    // Render sources (contrast range & colortable of each channel)
+    RenderChannel channels[4];
 	for (int i = 0; i < 4; i++)
 	{
         float* scanImage = m_vecVisImage.at(i).raw_ptr();
+        if (m_pMedfilt->getKernel() && (visible[i] || visible[4]))
+        {
+            // Median filtering on float data (out-of-place into the render source)
+            (*m_pMedfilt)(scanImage, m_vecFiltImage.at(i).raw_ptr());
+            scanImage = m_vecFiltImage.at(i).raw_ptr();
+        }
+        channels[i].src = scanImage;
+        channels[i].min = m_pConfig->imageContrastRange[i].min;
+        channels[i].max = m_pConfig->imageContrastRange[i].max;
+        channels[i].lut = ColorTable::lut(color_table_index[m_pConfig->channelImageMode[i]]).lut12; // shared LUT of the mode
+        channels[i].lut_size = LUT_SIZE_12;
+
+        // Intensity-weighted lifetime (hue LUT over the lifetime range, same render pass)
+        channels[i].lifetime = nullptr;
+        channels[i].lt_min = m_pConfig->lifetimeRange.min;
+        channels[i].lt_max = m_pConfig->lifetimeRange.max;
+        if (m_pStreamTab->isLifetimeRendering())
+        {
+            channels[i].lifetime = m_vecLifetimeImage.at(i).raw_ptr();
+            channels[i].lut = ColorTable::lut(ColorTable::hsv).lut12;
+        }
 
-        // Scaling
-        ippiScale_32f8u_C1R(scanImage, sizeof(float) * roi_image.width, m_pImgObj[i]->arr.raw_ptr(), sizeof(uint8_t) * roi_image.width,
-            roi_image, m_pConfig->imageContrastRange[i].min, m_pConfig->imageContrastRange[i].max);
-#ifdef MED_FILT
-		(*m_pMedfilt)(m_pImgObj[i]->arr.raw_ptr());
-#endif
+        // Clipping & saturation overlay (masks from the same comparisons in the render pass)
+        channels[i].overlay = m_pConfig->clippingOverlay[i];
+        channels[i].saturation = (m_pConfig->saturationLevel[i] > 0) ? m_pConfig->saturationLevel[i] : FLT_MAX;
 	}
 
-    // Visualization signal emit
-	if (!m_pCheckBox_SingleModeVisualization->isChecked())
-	{
-        emit plotCh1Image(m_pImgObj[0]->qindeximg.bits());
-        emit plotCh2Image(m_pImgObj[1]->qindeximg.bits());
-        emit plotCh3Image(m_pImgObj[2]->qindeximg.bits());
-        emit plotCh4Image(m_pImgObj[3]->qindeximg.bits());
-	}
-	else
-    {
-        if (!m_pCheckBox_RGBImage->isChecked())
+    // Rendering (scaling + colortable + blending in a single pass, zoom region at on-screen resolution)
+    // Float data is looked up at 12-bit precision in the shared LUTs (a mode change only swaps the LUT pointer)
+    auto renderView = [&](int i, RenderChannel* chs, int n) {
+        const RenderTarget& target = m_renderTargets[i];
+        for (int c = 0; c < n; c++)
         {
-            int mode = m_pComboBox_SingleModeVisualization->currentIndex();
-
-            switch (mode)
-            {
-            case 0:
-                emit plotCh1Image(m_pImgObj[0]->qindeximg.bits());
-                break;
-            case 1:
-                emit plotCh2Image(m_pImgObj[1]->qindeximg.bits());
-                break;
-            case 2:
-                emit plotCh3Image(m_pImgObj[2]->qindeximg.bits());
-                break;
-            case 3:
-                emit plotCh4Image(m_pImgObj[3]->qindeximg.bits());
-                break;
-            default:
-                break;
-            }
+            chs[c].src += target.roi.y() * m_pConfig->nPixels + target.roi.x();
+            if (chs[c].lifetime)
+                chs[c].lifetime += target.roi.y() * m_pConfig->nPixels + target.roi.x();
         }
-        else
+        renderImage((uint32_t*)target.buffer, target.size.width(), target.size.height(), chs, n, m_pConfig->nPixels, target.decimation);
+    };
+
+    int views = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (!visible[i]) continue;
+        RenderChannel channel = channels[i];
+        renderView(i, &channel, 1);
+        views++;
+    }
+
+    if (visible[4])
+    {
+        int cars = 0, tpfe = 0, shg = 0;
+        for (int i = 0; i < 4; i++)
         {
-            m_pImgObj[4]->convertRgb();
+            if (m_pConfig->channelImageMode[i] == CARS)
+                cars = i;
+            if (m_pConfig->channelImageMode[i] == TPFE)
+                tpfe = i;
+            if (m_pConfig->channelImageMode[i] == SHG)
+                shg = i;
+        }
 
-            IppiSize img_size = { m_pImgObj[4]->arr.size(0), m_pImgObj[4]->arr.size(1) };
+        // Additive composite: CARS (R) + TPFE (G) + SHG (B)
+        RenderChannel composite[3] = { channels[cars], channels[tpfe], channels[shg] };
+        composite[0].lut = ColorTable::lut(ColorTable::redo).lut12;
+        composite[1].lut = ColorTable::lut(ColorTable::greeno).lut12;
+        composite[2].lut = ColorTable::lut(ColorTable::blueo).lut12;
+        for (int c = 0; c < 3; c++)
+            composite[c].lifetime = nullptr; // intensity only
 
-            int cars = 0, tpfe = 0, shg = 0;
-            for (int i = 0; i < 4; i++)
-            {
-                if (m_pConfig->channelImageMode[i] == CARS)
-                    cars = i;
-                if (m_pConfig->channelImageMode[i] == TPFE)
-                    tpfe = i;
-                if (m_pConfig->channelImageMode[i] == SHG)
-                    shg = i;
-            }
+        renderView(4, composite, 3);
+        views++;
+    }
 
-            ippiCopy_8u_C1C3R(m_pImgObj[cars]->arr, img_size.width,
-                              m_pImgObj[4]->qrgbimg.bits() + 0, 3 * img_size.width, img_size);
-            ippiCopy_8u_C1C3R(m_pImgObj[tpfe]->arr, img_size.width,
-                              m_pImgObj[4]->qrgbimg.bits() + 1, 3 * img_size.width, img_size);
-            ippiCopy_8u_C1C3R(m_pImgObj[shg]->arr, img_size.width,
-                              m_pImgObj[4]->qrgbimg.bits() + 2, 3 * img_size.width, img_size);
+    m_nRenderViews = views;
+    m_renderFrameNsecs = timer.nsecsElapsed();
 
-            emit plotRGBImage(m_pImgObj[4]->qrgbimg.bits());
-        }
-	}
+    // Finished display buffers are swapped in by the UI thread (queued)
+    emit renderFinished();
+}
+
+void QVisualizationTab::drawRenderedImages()
+{
+    // UI thread: swap the finished buffers in (blitted by the viewers' paint events) & show the ROI statistics
+    QElapsedTimer timer;
+    timer.start();
+
+    if (m_renderTargets[0].buffer) emit plotCh1Image(m_renderTargets[0].buffer);
+    if (m_renderTargets[1].buffer) emit plotCh2Image(m_renderTargets[1].buffer);
+    if (m_renderTargets[2].buffer) emit plotCh3Image(m_renderTargets[2].buffer);
+    if (m_renderTargets[3].buffer) emit plotCh4Image(m_renderTargets[3].buffer);
+    if (m_renderTargets[4].buffer) emit plotRGBImage(m_renderTargets[4].buffer);
+
+    showRoiStats();
+
+    // Live focus metric (of the last formed image)
+    if (m_pConfig->focusMetric)
+    {
+        QString str;
+        for (int i = 0; i < 4; i++)
+            str += QString("%1 %2  ").arg(mode_name[m_pConfig->channelImageMode[i]]).arg((double)m_pStreamTab->m_focusValue[i], 0, 'g', 4);
+        m_pLabel_FocusMetric->setText(str.trimmed());
+    }
+
+    m_uiNsecs += timer.nsecsElapsed();
+    reportRenderTime(m_nRenderViews, m_renderFrameNsecs);
+
+    // Next frame (published or requested while rendering)
+    m_bRenderBusy = false;
+    if (m_bDrawPending)
+        visualizeImage();
+}
+
+void QVisualizationTab::reportRenderTime(int views, qint64 nsecs)
+{
+    m_nDisplayedFrames++;
+    m_nRenderedViews += views;
+    m_renderNsecs += nsecs;
+
+    qint64 period = m_displayClock.elapsed() - m_lastReportTime;
+    if (period < 1000)
+        return;
+
+    // Saved time: compared to rendering all 5 views of every published frame
+    int published = m_nPublishedFrames.exchange(0);
+    if (m_nRenderedViews > 0)
+        m_viewRenderTime = (double)m_renderNsecs / 1e6 / (double)m_nRenderedViews;
+    double render = (double)m_renderNsecs / 1e6 * 1000.0 / (double)period;
+    double saved = qMax(5 * published - m_nRenderedViews, 0) * m_viewRenderTime * 1000.0 / (double)period;
+    double ui = (double)m_uiNsecs / 1e6 / (double)m_nDisplayedFrames; // UI thread time per displayed frame
+
+    m_pStreamTab->getMainWnd()->m_pStatusLabel_Render->setText(QString("Display: %1 / %2 fps | Render: %3 ms/s (saved %4 ms/s) | UI: %5 ms/frame")
+        .arg(m_nDisplayedFrames * 1000.0 / period, 4, 'f', 1).arg(published * 1000.0 / period, 4, 'f', 1).arg(render, 4, 'f', 1).arg(saved, 4, 'f', 1).arg(ui, 4, 'f', 2));
+
+    m_lastReportTime = m_displayClock.elapsed();
+    m_nDisplayedFrames = m_nRenderedViews = 0;
+    m_renderNsecs = m_uiNsecs = 0;
 }
 
 
@@ -426,19 +833,14 @@ void QVisualizationTab::setCh1ImageMode(int mode)
     m_pConfig->channelImageMode[0] = mode;
 
     // Colormap reset
-    m_pImageView_Image[0]->resetColormap(ColorTable::colortable(color_table_index[mode]));
     m_pImageView_ModeColorbar[0]->resetColormap(ColorTable::colortable(color_table_index[mode]));
 
-    ColorTable temp_ctable;
-    delete m_pImgObj[0];
-    m_pImgObj[0] = new ImageObject(m_pConfig->nPixels, m_pConfig->nLines, temp_ctable.m_colorTableVector.at(color_table_index[mode]));
-
     // Contrast reset
     m_pLineEdit_ContrastMax[0]->setText(QString::number(m_pConfig->imageContrastRange[mode].max, 'f', 1));
     m_pLineEdit_ContrastMin[0]->setText(QString::number(m_pConfig->imageContrastRange[mode].min, 'f', 1));
 
     // Update
-    m_pImageView_Image[0]->getRender()->update();
+    emit drawImage();
 }
 
 void QVisualizationTab::setCh2ImageMode(int mode)
@@ -446,19 +848,14 @@ void QVisualizationTab::setCh2ImageMode(int mode)
     m_pConfig->channelImageMode[1] = mode;
 
     // Colormap reset
-    m_pImageView_Image[1]->resetColormap(ColorTable::colortable(color_table_index[mode]));
     m_pImageView_ModeColorbar[1]->resetColormap(ColorTable::colortable(color_table_index[mode]));
 
-    ColorTable temp_ctable;
-    delete m_pImgObj[1];
-    m_pImgObj[1] = new ImageObject(m_pConfig->nPixels, m_pConfig->nLines, temp_ctable.m_colorTableVector.at(color_table_index[mode]));
-
     // Contrast reset
     m_pLineEdit_ContrastMax[1]->setText(QString::number(m_pConfig->imageContrastRange[mode].max, 'f', 1));
     m_pLineEdit_ContrastMin[1]->setText(QString::number(m_pConfig->imageContrastRange[mode].min, 'f', 1));
 
     // Update
-    m_pImageView_Image[1]->getRender()->update();
+    emit drawImage();
 }
 
 void QVisualizationTab::setCh3ImageMode(int mode)
@@ -466,19 +863,14 @@ void QVisualizationTab::setCh3ImageMode(int mode)
     m_pConfig->channelImageMode[2] = mode;
 
     // Colormap reset
-    m_pImageView_Image[2]->resetColormap(ColorTable::colortable(color_table_index[mode]));
     m_pImageView_ModeColorbar[2]->resetColormap(ColorTable::colortable(color_table_index[mode]));
 
-    ColorTable temp_ctable;
-    delete m_pImgObj[2];
-    m_pImgObj[2] = new ImageObject(m_pConfig->nPixels, m_pConfig->nLines, temp_ctable.m_colorTableVector.at(color_table_index[mode]));
-
     // Contrast reset
     m_pLineEdit_ContrastMax[2]->setText(QString::number(m_pConfig->imageContrastRange[mode].max, 'f', 1));
     m_pLineEdit_ContrastMin[2]->setText(QString::number(m_pConfig->imageContrastRange[mode].min, 'f', 1));
 
     // Update
-    m_pImageView_Image[2]->getRender()->update();
+    emit drawImage();
 }
 
 void QVisualizationTab::setCh4ImageMode(int mode)
@@ -486,19 +878,14 @@ void QVisualizationTab::setCh4ImageMode(int mode)
     m_pConfig->channelImageMode[3] = mode;
 
     // Colormap reset
-    m_pImageView_Image[3]->resetColormap(ColorTable::colortable(color_table_index[mode]));
     m_pImageView_ModeColorbar[3]->resetColormap(ColorTable::colortable(color_table_index[mode]));
 
-    ColorTable temp_ctable;
-    delete m_pImgObj[3];
-    m_pImgObj[3] = new ImageObject(m_pConfig->nPixels, m_pConfig->nLines, temp_ctable.m_colorTableVector.at(color_table_index[mode]));
-
     // Contrast reset
     m_pLineEdit_ContrastMax[3]->setText(QString::number(m_pConfig->imageContrastRange[mode].max, 'f', 1));
     m_pLineEdit_ContrastMin[3]->setText(QString::number(m_pConfig->imageContrastRange[mode].min, 'f', 1));
 
     // Update
-    m_pImageView_Image[3]->getRender()->update();
+    emit drawImage();
 }
 
 void QVisualizationTab::adjustImageContrast()
@@ -511,3 +898,275 @@ void QVisualizationTab::adjustImageContrast()
 
     emit drawImage();
 }
+
+void QVisualizationTab::changeClippingOverlay(bool)
+{
+    for (int i = 0; i < 4; i++)
+        m_pConfig->clippingOverlay[i] = m_pCheckBox_ClippingOverlay[i]->isChecked();
+
+    emit drawImage();
+}
+
+void QVisualizationTab::changeAutoContrast(bool toggled)
+{
+    m_pConfig->autoContrast = toggled;
+    m_pStreamTab->m_histogram.resetRange();
+
+    for (int i = 0; i < 4; i++)
+    {
+        m_pLineEdit_ContrastMax[i]->setEnabled(!toggled);
+        m_pLineEdit_ContrastMin[i]->setEnabled(!toggled);
+    }
+}
+
+void QVisualizationTab::changeAutoContrastPercentile(const QString &)
+{
+    float low = m_pLineEdit_AutoContrastLow->text().toFloat();
+    float high = m_pLineEdit_AutoContrastHigh->text().toFloat();
+
+    if ((low >= 0.0f) && (high <= 100.0f) && (low < high))
+    {
+        m_pConfig->autoContrastLow = low;
+        m_pConfig->autoContrastHigh = high;
+    }
+}
+
+void QVisualizationTab::changeMedianFilter(int index)
+{
+    m_pConfig->medianFilterSize = (index > 0) ? 2 * index + 1 : 0;
+    m_pMedfilt->setKernel(m_pConfig->medianFilterSize);
+
+    emit drawImage();
+}
+
+void QVisualizationTab::changeDisplayRate(const QString &str)
+{
+    int rate = str.toInt();
+    if (rate > 0)
+        m_pConfig->displayRate = rate;
+}
+
+void QVisualizationTab::changeLifetimeRendering(bool toggled)
+{
+    // Lifetime planes are allocated with the visualization buffers (applied from the next acquisition)
+    m_pConfig->lifetimeRendering = toggled;
+    if (m_pStreamTab->getOperationTab()->isAcquisitionButtonToggled())
+        emit m_pStreamTab->sendStatusMessage("Lifetime rendering is applied from the next acquisition.", false);
+
+    emit drawImage();
+}
+
+void QVisualizationTab::adjustLifetimeRange()
+{
+    float min = m_pLineEdit_LifetimeMin->text().toFloat();
+    float max = m_pLineEdit_LifetimeMax->text().toFloat();
+    if (min < max)
+    {
+        m_pConfig->lifetimeRange.min = min;
+        m_pConfig->lifetimeRange.max = max;
+    }
+
+    emit drawImage();
+}
+
+void QVisualizationTab::changeFocusMetric(bool toggled)
+{
+    m_pConfig->focusMetric = toggled;
+    m_pLabel_FocusMetric->setVisible(toggled);
+}
+
+void QVisualizationTab::changeFocusMetricMode(int mode)
+{
+    m_pConfig->focusMetricMode = mode;
+}
+
+
+void QVisualizationTab::updateRoiStats(const float* const* images, bool record)
+{
+    // Statistics (rect) or profile (line) of each channel (float images)
+    std::unique_lock<std::mutex> lock(m_mtxRoi);
+
+    m_nRoiProfileLength = 0;
+    if (!m_roiStats.isValid())
+        return;
+
+    int len = (m_roiStats.getMode() == ROI_LINE) ? qMin(m_roiStats.getProfileLength(), m_roiProfile.size(0)) : 0;
+    for (int i = 0; i < 4; i++)
+    {
+        const float* image = images[i];
+        if (m_roiStats.getMode() == ROI_RECT)
+            m_roiStatistics[i] = m_roiStats.statistics(image, m_pConfig->nPixels, m_pConfig->nLines);
+        else
+        {
+            m_roiStatistics[i] = {};
+            m_roiStats.profile(image, m_pConfig->nPixels, m_pConfig->nLines, &m_roiProfile(0, i));
+        }
+    }
+    m_nRoiProfileLength = len;
+
+    // Time series (every formed image)
+    if (m_bRoiRecording && record)
+    {
+        m_roiSeries.push_back((float)m_displayClock.elapsed());
+        for (int i = 0; i < 4; i++)
+        {
+            m_roiSeries.push_back(m_roiStatistics[i].mean); m_roiSeries.push_back(m_roiStatistics[i].std);
+            m_roiSeries.push_back(m_roiStatistics[i].min); m_roiSeries.push_back(m_roiStatistics[i].max);
+        }
+        if (len > 0)
+        {
+            m_roiProfileSeries.push_back((float)len);
+            for (int i = 0; i < 4; i++)
+                for (int j = 0; j < len; j++)
+                    m_roiProfileSeries.push_back(m_roiProfile(j, i));
+        }
+        m_nRoiFrames++;
+    }
+}
+
+void QVisualizationTab::showRoiStats()
+{
+    // UI thread: results of the latest formed image
+    std::unique_lock<std::mutex> lock(m_mtxRoi);
+
+    if (!m_roiStats.isValid())
+        return;
+
+    if (m_roiStats.getMode() == ROI_RECT)
+    {
+        QString str;
+        for (int i = 0; i < 4; i++)
+        {
+            const RoiStatistics& stats = m_roiStatistics[i];
+            str += QString("%1 %2 +/- %3 [%4 %5]\n").arg(mode_name[m_pConfig->channelImageMode[i]], -4)
+                .arg(stats.mean, 7, 'f', 3).arg(stats.std, 6, 'f', 3).arg(stats.min, 6, 'f', 2).arg(stats.max, 6, 'f', 2);
+        }
+        str.chop(1);
+        m_pLabel_RoiStats->setText(str);
+    }
+    else
+    {
+        // Profiles normalized by the contrast range of each channel
+        int len = m_nRoiProfileLength;
+        np::FloatArray norm(qMax(len, 1));
+        for (int i = 0; i < 4; i++)
+        {
+            float min = m_pConfig->imageContrastRange[i].min, max = m_pConfig->imageContrastRange[i].max;
+            float scale = (max != min) ? 1.0f / (max - min) : 0.0f;
+            for (int j = 0; j < len; j++)
+                norm[j] = (m_roiProfile(j, i) - min) * scale;
+            m_pScope_RoiProfile->drawData(i, norm.raw_ptr(), len);
+        }
+        m_pScope_RoiProfile->resetAxis({ 0, (double)len }, { 0, 1 });
+    }
+}
+
+void QVisualizationTab::changeRoiMode(int mode)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mtxRoi);
+        m_roiStats.setMode(mode);
+    }
+    m_bRoiChanged = true;
+    for (int i = 0; i < 5; i++)
+    {
+        m_pImageView_Image[i]->getRender()->m_nMeasureMode = mode;
+        m_pImageView_Image[i]->getRender()->update();
+    }
+
+    m_pLabel_RoiStats->setVisible(mode == ROI_RECT);
+    m_pScope_RoiProfile->setVisible(mode == ROI_LINE);
+    m_pToggleButton_RoiRecord->setEnabled(mode != ROI_NONE);
+    if (mode == ROI_NONE)
+        m_pToggleButton_RoiRecord->setChecked(false);
+
+    emit drawImage();
+}
+
+void QVisualizationTab::recordRoiStats(bool toggled)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mtxRoi);
+        if (toggled)
+        {
+            m_roiSeries.clear();
+            m_roiProfileSeries.clear();
+            m_nRoiFrames = 0;
+        }
+        m_bRoiRecording = toggled;
+    }
+
+    m_pComboBox_RoiMode->setDisabled(toggled);
+    m_pPushButton_RoiExport->setEnabled(!toggled && (m_nRoiFrames > 0));
+}
+
+void QVisualizationTab::exportRoiStats()
+{
+    QString fileName = QFileDialog::getSaveFileName(nullptr, "Export ROI Statistics", "", "CSV (*.csv)");
+    if (fileName.isEmpty())
+        return;
+
+    // Statistics: frame, time, 4 x (mean, std, min, max)
+    QFile file(fileName);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        QTextStream out(&file);
+        out << "frame,time_ms";
+        for (int i = 0; i < 4; i++)
+            out << QString(",%1_mean,%1_std,%1_min,%1_max").arg(mode_name[m_pConfig->channelImageMode[i]]);
+        out << "\n";
+
+        for (int k = 0; k < m_nRoiFrames; k++)
+        {
+            const float* rec = &m_roiSeries[17 * k];
+            out << k << "," << rec[0] - m_roiSeries[0];
+            for (int j = 1; j < 17; j++)
+                out << "," << rec[j];
+            out << "\n";
+        }
+        file.close();
+    }
+
+    // Line profiles: frame, channel, samples
+    if (!m_roiProfileSeries.isEmpty())
+    {
+        QFile file_profile(QFileInfo(fileName).path() + "/" + QFileInfo(fileName).completeBaseName() + "_profile.csv");
+        if (file_profile.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            QTextStream out(&file_profile);
+            int pos = 0;
+            for (int k = 0; pos < m_roiProfileSeries.size(); k++)
+            {
+                int len = (int)m_roiProfileSeries[pos++];
+                for (int i = 0; i < 4; i++, pos += len)
+                {
+                    out << k << "," << mode_name[m_pConfig->channelImageMode[i]];
+                    for (int j = 0; j < len; j++)
+                        out << "," << m_roiProfileSeries[pos + j];
+                    out << "\n";
+                }
+            }
+            file_profile.close();
+        }
+    }
+
+    m_pStreamTab->getMainWnd()->m_pStatusLabel_ImagePos->setText(QString("ROI statistics of %1 frames exported.").arg(m_nRoiFrames));
+}
+
+void QVisualizationTab::createHistogramDlg()
+{
+    if (m_pHistogramDlg == nullptr)
+    {
+        m_pHistogramDlg = new HistogramDlg(this);
+        connect(m_pHistogramDlg, SIGNAL(finished(int)), this, SLOT(deleteHistogramDlg()));
+        m_pHistogramDlg->show();
+    }
+    m_pHistogramDlg->raise();
+    m_pHistogramDlg->activateWindow();
+}
+
+void QVisualizationTab::deleteHistogramDlg()
+{
+    m_pHistogramDlg->deleteLater();
+    m_pHistogramDlg = nullptr;
+}
@@ -7,14 +7,23 @@
 
 #include <Doulos/Configuration.h>
 
+#include <Doulos/Viewer/QImageView.h>
+#include <Doulos/Viewer/QScope.h>
+
 #include <Common/medfilt.h>
-#include <Common/ImageObject.h>
+#include <Common/ImageRender.h>
+#include <Common/TripleBuffer.h>
+#include <Common/RoiStats.h>
 
 #include <iostream>
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 class QStreamTab;
-class QImageView;
+class ThreadManager;
+class HistogramDlg;
 
 
 class QVisualizationTab : public QDialog
@@ -29,6 +38,8 @@ public:
 // Methods //////////////////////////////////////////////
 public:
     inline QGridLayout* getLayout() const { return m_pGridLayout; }
+    inline QStreamTab* getStreamTab() const { return m_pStreamTab; }
+    inline HistogramDlg* getHistogramDlg() const { return m_pHistogramDlg; }
 	inline QGroupBox* getVisualizationWidgetsBox() const { return m_pGroupBox_VisualizationWidgets; }
 	//inline QGroupBox* getDataVisualizationBox() const { return m_pGroupBox_DataVisualization; }
 	inline QGroupBox* getAveragingBox() const { return m_pGroupBox_Averaging; }
@@ -42,11 +53,19 @@ public:
 	void setImgViewVisPixelPos(bool);
 	void getPixelPos(int* x, int* y);
     void setRelevantWidgets(bool enabled);
+    void publishImage();
+    void updateRoiStats(const float* const* images, bool record); // once per formed image (image formation thread)
+
+private:
+    void renderFrame();
+    void reportRenderTime(int views, qint64 nsecs);
+    void showRoiStats();
 
 public slots:
     void visualizeImage();
 
 private slots:
+    void drawRenderedImages();
     void setSingleModeVisualization(bool);
 	void changeImageMode(int);
     void setRGBImageVisualization(bool);
@@ -55,9 +74,24 @@ private slots:
     void setCh3ImageMode(int);
     void setCh4ImageMode(int);
     void adjustImageContrast();
+    void changeClippingOverlay(bool);
+    void changeAutoContrast(bool);
+    void changeAutoContrastPercentile(const QString &);
+    void changeMedianFilter(int);
+    void changeDisplayRate(const QString &);
+    void changeLifetimeRendering(bool);
+    void adjustLifetimeRange();
+    void changeFocusMetric(bool);
+    void changeFocusMetricMode(int);
+    void changeRoiMode(int);
+    void recordRoiStats(bool);
+    void exportRoiStats();
+    void createHistogramDlg();
+    void deleteHistogramDlg();
 
 signals:
     void drawImage();
+    void renderFinished();
     void plotCh1Image(uint8_t*);
     void plotCh2Image(uint8_t*);
     void plotCh3Image(uint8_t*);
@@ -70,18 +104,65 @@ private:
     Configuration* m_pConfig;
 
 public:
-    // Visualization buffers
+    // Visualization buffers (views of the front image of the mailbox)
     std::vector<np::FloatArray2> m_vecVisImage;
+    std::vector<np::FloatArray2> m_vecLifetimeImage; // intensity-weighted mean delay (nsec)
+
+    // Latest-frame mailbox (nPixels x 8 * nLines: 4 intensity & 4 lifetime images) & pending draw flag
+    TripleBuffer<np::FloatArray2> m_visImageBuffer;
+    std::atomic<bool> m_bDrawPending;
+    std::atomic<int> m_nPublishedFrames;
 
     // CRS nonlinearity compensation idx
     np::FloatArray2 m_pCRSCompIdx;
 
 private:
-    // Image visualization buffers
-    ImageObject *m_pImgObj[5];
+    // Median filtered images (render sources when the filter is on)
+    std::vector<np::FloatArray2> m_vecFiltImage;
 
 	medfilt* m_pMedfilt;
 
+    // Histogram viewer
+    HistogramDlg *m_pHistogramDlg;
+
+    // Display-rate throttling & render time statistics
+    QTimer *m_pTimer_Display;
+    QElapsedTimer m_displayClock;
+    qint64 m_lastDisplayTime, m_lastReportTime;
+    int m_nDisplayedFrames, m_nRenderedViews;
+    qint64 m_renderNsecs, m_uiNsecs;
+    double m_viewRenderTime; // ms per view
+
+    // Render worker: one frame in flight, rendered into the back images of the viewers
+    struct RenderTarget
+    {
+        uint8_t* buffer; // nullptr: not visible
+        QRect roi;
+        QSize size;
+        int decimation;
+    };
+    RenderTarget m_renderTargets[5];
+    ThreadManager* m_pThreadRender;
+    std::mutex m_mtxRender;
+    std::condition_variable m_cvRender;
+    bool m_bRenderRequest, m_bRenderStop;
+    std::atomic<bool> m_bRenderBusy;
+    int m_nRenderViews;
+    qint64 m_renderFrameNsecs;
+    std::mutex m_mtxFront; // front image views (replaced by the render worker)
+
+    // ROI statistics & line profiles (float images, by the render worker), time series while recording
+    std::mutex m_mtxRoi;
+    RoiStats m_roiStats;
+    RoiStatistics m_roiStatistics[4];
+    np::FloatArray2 m_roiProfile; // (profile length, 4)
+    int m_nRoiProfileLength;
+    bool m_bRoiRecording;
+    std::atomic<bool> m_bRoiChanged; // recomputed on the displayed image (no new image formed)
+    int m_nRoiFrames;
+    QVector<float> m_roiSeries; // per frame: time (ms), 4 x (mean, std, min, max)
+    QVector<float> m_roiProfileSeries; // per frame: length, 4 x profile
+
 private:
     // Layout
     QGridLayout *m_pGridLayout;
@@ -101,10 +182,39 @@ private:
 
     QCheckBox *m_pCheckBox_RGBImage;
 
+    QLabel *m_pLabel_MedianFilter;
+    QComboBox *m_pComboBox_MedianFilter;
+
+    QLabel *m_pLabel_DisplayRate;
+    QLineEdit *m_pLineEdit_DisplayRate;
+
     QComboBox *m_pComboBox_ModeName[4];
     QLineEdit *m_pLineEdit_ContrastMax[4];
     QLineEdit *m_pLineEdit_ContrastMin[4];
     QImageView *m_pImageView_ModeColorbar[4];
+    QCheckBox *m_pCheckBox_ClippingOverlay[4];
+
+    QCheckBox *m_pCheckBox_AutoContrast;
+    QLineEdit *m_pLineEdit_AutoContrastLow;
+    QLineEdit *m_pLineEdit_AutoContrastHigh;
+    QLabel *m_pLabel_AutoContrast;
+    QPushButton *m_pPushButton_Histogram;
+
+    QCheckBox *m_pCheckBox_LifetimeRendering;
+    QLineEdit *m_pLineEdit_LifetimeMin;
+    QLineEdit *m_pLineEdit_LifetimeMax;
+    QLabel *m_pLabel_Lifetime;
+
+    QCheckBox *m_pCheckBox_FocusMetric;
+    QComboBox *m_pComboBox_FocusMetric;
+    QLabel *m_pLabel_FocusMetric;
+
+    QLabel *m_pLabel_RoiMode;
+    QComboBox *m_pComboBox_RoiMode;
+    QPushButton *m_pToggleButton_RoiRecord;
+    QPushButton *m_pPushButton_RoiExport;
+    QLabel *m_pLabel_RoiStats;
+    QScope *m_pScope_RoiProfile;
 };
 
 #endif // QVISUALIZATIONTAB_H
@@ -3,52 +3,84 @@
 #include "QImageView.h"
 #include <ipps.h>
 
+#include <vector>
 
-ColorTable::ColorTable()
+
+// Color tables loaded once (files) & shared by all ColorTable objects (implicitly shared QVectors)
+struct SharedColorTables
 {
-	// Color table list	
-	m_cNameVector.push_back("gray");
-	m_cNameVector.push_back("invgray");
-	m_cNameVector.push_back("sepia");
-	m_cNameVector.push_back("jet");
-	m_cNameVector.push_back("parula");
-	m_cNameVector.push_back("hot");
-	m_cNameVector.push_back("fire");
-	m_cNameVector.push_back("hsv");
-	m_cNameVector.push_back("smart");
-	m_cNameVector.push_back("bor");
-	m_cNameVector.push_back("cool");
-	m_cNameVector.push_back("gem");
-	m_cNameVector.push_back("gfb");
-	m_cNameVector.push_back("ice");
-	m_cNameVector.push_back("lifetime2");
-	m_cNameVector.push_back("vessel");
-	m_cNameVector.push_back("hsv1");
-	m_cNameVector.push_back("blue_hot");
-    m_cNameVector.push_back("red");
-    m_cNameVector.push_back("green");
-    m_cNameVector.push_back("blue");
-    m_cNameVector.push_back("redo");
-    m_cNameVector.push_back("greeno");
-    m_cNameVector.push_back("blueo");
-	// ο  ̸ ߰ ϱ
-
-	for (int i = 0; i < m_cNameVector.size(); i++)
+	SharedColorTables()
 	{
-		QFile file("ColorTable/" + m_cNameVector.at(i) + ".colortable");
-		file.open(QIODevice::ReadOnly);
-		np::Uint8Array2 rgb(256, 3);
-		file.read(reinterpret_cast<char*>(rgb.raw_ptr()), sizeof(uint8_t) * rgb.length());
-		file.close();
-
-		QVector<QRgb> temp_vector;
-		for (int j = 0; j < 256; j++)
+		// Color table list	
+		m_cNameVector.push_back("gray");
+		m_cNameVector.push_back("invgray");
+		m_cNameVector.push_back("sepia");
+		m_cNameVector.push_back("jet");
+		m_cNameVector.push_back("parula");
+		m_cNameVector.push_back("hot");
+		m_cNameVector.push_back("fire");
+		m_cNameVector.push_back("hsv");
+		m_cNameVector.push_back("smart");
+		m_cNameVector.push_back("bor");
+		m_cNameVector.push_back("cool");
+		m_cNameVector.push_back("gem");
+		m_cNameVector.push_back("gfb");
+		m_cNameVector.push_back("ice");
+		m_cNameVector.push_back("lifetime2");
+		m_cNameVector.push_back("vessel");
+		m_cNameVector.push_back("hsv1");
+		m_cNameVector.push_back("blue_hot");
+		m_cNameVector.push_back("red");
+		m_cNameVector.push_back("green");
+		m_cNameVector.push_back("blue");
+		m_cNameVector.push_back("redo");
+		m_cNameVector.push_back("greeno");
+		m_cNameVector.push_back("blueo");
+		// ο  ̸ ߰ ϱ
+
+		for (int i = 0; i < m_cNameVector.size(); i++)
 		{
-			QRgb color = qRgb(rgb(j, 0), rgb(j, 1), rgb(j, 2));
-			temp_vector.push_back(color);
+			QFile file("ColorTable/" + m_cNameVector.at(i) + ".colortable");
+			file.open(QIODevice::ReadOnly);
+			np::Uint8Array2 rgb(256, 3);
+			file.read(reinterpret_cast<char*>(rgb.raw_ptr()), sizeof(uint8_t) * rgb.length());
+			file.close();
+
+			QVector<QRgb> temp_vector;
+			for (int j = 0; j < 256; j++)
+			{
+				QRgb color = qRgb(rgb(j, 0), rgb(j, 1), rgb(j, 2));
+				temp_vector.push_back(color);
+			}
+			m_colorTableVector.push_back(temp_vector);
 		}
-		m_colorTableVector.push_back(temp_vector);
+
+		// Aligned 8-bit & 12-bit LUTs of the render kernel
+		m_colorLut.resize(m_colorTableVector.size());
+		for (int i = 0; i < m_colorTableVector.size(); i++)
+			m_colorLut[i].build(m_colorTableVector.at(i).constData());
 	}
+
+	QVector<QString> m_cNameVector;
+	ColorTableVector m_colorTableVector;
+	std::vector<ColorLut> m_colorLut;
+};
+
+static const SharedColorTables& sharedColorTables()
+{
+	static SharedColorTables shared; // thread-safe initialization
+	return shared;
+}
+
+
+ColorTable::ColorTable() :
+	m_cNameVector(sharedColorTables().m_cNameVector), m_colorTableVector(sharedColorTables().m_colorTableVector)
+{
+}
+
+const ColorLut& ColorTable::lut(int ctable)
+{
+	return sharedColorTables().m_colorLut.at(ctable);
 }
 
 
@@ -59,7 +91,7 @@ QImageView::QImageView(QWidget *parent) :
 }
 
 QImageView::QImageView(ColorTable::colortable ctable, int width, int height, bool rgb, QWidget *parent) :
-    QDialog(parent), m_bSquareConstraint(false), m_bRgbUsed(rgb)
+    QDialog(parent), m_nBackBuffer(0), m_nDecimation(1), m_bSquareConstraint(false), m_bRgbUsed(rgb)
 {
     // Set default size
     resize(400, 400);  //400 400
@@ -78,17 +110,8 @@ QImageView::QImageView(ColorTable::colortable ctable, int width, int height, boo
 	m_pRenderImage->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
 	m_pHBoxLayout->addWidget(m_pRenderImage);	
 
-    // Create QImage object  
-	if (!m_bRgbUsed)
-	{
-		m_pRenderImage->m_pImage = new QImage(m_width, m_height, QImage::Format_Indexed8);
-		m_pRenderImage->m_pImage->setColorCount(256);
-		m_pRenderImage->m_pImage->setColorTable(m_colorTable.m_colorTableVector.at(ctable));
-	}
-	else
-		m_pRenderImage->m_pImage = new QImage(m_width, m_height, QImage::Format_RGB888);
-
-	memset(m_pRenderImage->m_pImage->bits(), 0, m_pRenderImage->m_pImage->byteCount());
+    // Create QImage objects
+	createImages(m_colorTable.m_colorTableVector.at(ctable));
 
 	// Set layout
 	setLayout(m_pHBoxLayout);
@@ -114,6 +137,9 @@ void QImageView::resizeEvent(QResizeEvent *)
 		else
 			resize(h, h);
 	}
+
+	// Render size follows the widget size
+	m_pRenderImage->DidChangedRoi();
 }
 
 void QImageView::resetSize(int width, int height, bool is_rgb)
@@ -123,34 +149,96 @@ void QImageView::resetSize(int width, int height, bool is_rgb)
 	m_height = height;	
 	m_bRgbUsed = is_rgb;
 
-	// Create QImage object
-	QRgb rgb[256];
-	if (!m_bRgbUsed)
+	// Create QImage objects (keeping the current colortable)
+	QVector<QRgb> colortable = m_image[0].colorTable();
+	createImages(colortable);
+}
+
+void QImageView::resetColormap(ColorTable::colortable ctable)
+{
+	for (int i = 0; i < 2; i++)
+		m_image[i].setColorTable(m_colorTable.m_colorTableVector.at(ctable));
+
+	m_pRenderImage->update();
+}
+
+void QImageView::createImages(const QVector<QRgb>& colortable)
+{
+	for (int i = 0; i < 2; i++)
 	{
-		for (int i = 0; i < 256; i++)
-			rgb[i] = m_pRenderImage->m_pImage->color(i);
+		if (!m_bRgbUsed)
+		{
+			m_image[i] = QImage(m_width, m_height, QImage::Format_Indexed8);
+			m_image[i].setColorCount(256);
+			if (colortable.size() == 256)
+				m_image[i].setColorTable(colortable);
+		}
+		else
+			m_image[i] = QImage(m_width, m_height, QImage::Format_RGB32);
+
+		memset(m_image[i].bits(), 0, m_image[i].byteCount());
+		m_imageRoi[i] = QRect(0, 0, m_width, m_height);
 	}
 
-	if (m_pRenderImage->m_pImage)
-		delete m_pRenderImage->m_pImage;
+	m_nBackBuffer = 0;
+	m_nDecimation = 1;
+	m_pRenderImage->m_pImage = &m_image[1];
+	m_pRenderImage->m_roi = m_imageRoi[1];
+	m_pRenderImage->m_imageSize = QSize(m_width, m_height);
+	m_pRenderImage->m_zoomRoi = m_imageRoi[1];
+}
 
-	if (!m_bRgbUsed)
+void QImageView::setZoomEnable(bool zoom)
+{
+	m_pRenderImage->m_bZoom = zoom;
+	if (!zoom)
+		m_pRenderImage->m_zoomRoi = QRect(0, 0, m_width, m_height);
+}
+
+uint8_t* QImageView::getRenderBuffer()
+{
+	// Zoom region box-decimated by an integer factor to (at least) the widget size
+	const QRect& roi = m_pRenderImage->m_zoomRoi;
+	int w = qMax(m_pRenderImage->width(), 1);
+	int h = qMax(m_pRenderImage->height(), 1);
+	m_nDecimation = qMax(1, qMin(roi.width() / w, roi.height() / h));
+
+	// Only the back image is reallocated (the front one is still on screen)
+	QImage& back = m_image[m_nBackBuffer];
+	QSize size(roi.width() / m_nDecimation, roi.height() / m_nDecimation);
+	if (back.size() != size)
 	{
-		m_pRenderImage->m_pImage = new QImage(m_width, m_height, QImage::Format_Indexed8);
-		m_pRenderImage->m_pImage->setColorCount(256);
-		for (int i = 0; i < 256; i++)
-			m_pRenderImage->m_pImage->setColor(i, rgb[i]);
+		QImage& front = m_image[m_nBackBuffer ^ 1];
+		back = QImage(size, front.format());
+		if (!m_bRgbUsed)
+			back.setColorTable(front.colorTable());
 	}
-	else
-		m_pRenderImage->m_pImage = new QImage(m_width, m_height, QImage::Format_RGB888);
-
-	memset(m_pRenderImage->m_pImage->bits(), 0, m_pRenderImage->m_pImage->byteCount());
+	m_imageRoi[m_nBackBuffer] = QRect(roi.x(), roi.y(), size.width() * m_nDecimation, size.height() * m_nDecimation);
 
+	return back.bits();
 }
 
-void QImageView::resetColormap(ColorTable::colortable ctable)
+void QImageView::swapImages(uint8_t* pImage)
 {
-	m_pRenderImage->m_pImage->setColorTable(m_colorTable.m_colorTableVector.at(ctable));
+	// Rendered directly into the back image: no copy, just swap
+	QImage& back = m_image[m_nBackBuffer];
+	if (pImage != back.constBits())
+	{
+		// External (full-size) image
+		if (back.size() != QSize(m_width, m_height))
+		{
+			QImage& front = m_image[m_nBackBuffer ^ 1];
+			back = QImage(m_width, m_height, front.format());
+			if (!m_bRgbUsed)
+				back.setColorTable(front.colorTable());
+		}
+		m_imageRoi[m_nBackBuffer] = QRect(0, 0, m_width, m_height);
+		memcpy(back.bits(), pImage, back.byteCount());
+	}
+
+	m_pRenderImage->m_pImage = &back;
+	m_pRenderImage->m_roi = m_imageRoi[m_nBackBuffer];
+	m_nBackBuffer ^= 1;
 
 	m_pRenderImage->update();
 }
@@ -209,26 +297,37 @@ void QImageView::setHLineChangeCallback(const std::function<void(int)>& slot)
 	m_pRenderImage->DidChangedHLine += slot;
 }
 
+void QImageView::setRoiChangedCallback(const std::function<void(void)>& slot)
+{
+	m_pRenderImage->DidChangedRoi.clear();
+	m_pRenderImage->DidChangedRoi += slot;
+}
+
+void QImageView::setMeasureChangedCallback(const std::function<void(void)>& slot)
+{
+	m_pRenderImage->DidChangedMeasure.clear();
+	m_pRenderImage->DidChangedMeasure += slot;
+}
+
 void QImageView::drawImage(uint8_t* pImage)
 {
-	memcpy(m_pRenderImage->m_pImage->bits(), pImage, m_pRenderImage->m_pImage->byteCount());	
-	m_pRenderImage->update();
+	swapImages(pImage);
 }
 
 void QImageView::drawRgbImage(uint8_t* pImage)
-{		
-	QImage *pImg = new QImage(pImage, m_width, m_height, QImage::Format_RGB888);
-	m_pRenderImage->m_pImage = std::move(pImg);
-	m_pRenderImage->update();
+{
+	swapImages(pImage);
 }
 
 QRenderImage::QRenderImage(QWidget *parent) :
-	QWidget(parent), m_pImage(nullptr), m_colorLine(0x00ff00),
-    m_bPixelPos(false),	m_bMeasureDistance(false), m_nClicked(0), m_hLineLen(0), m_vLineLen(0)
+	QWidget(parent), m_pImage(nullptr), m_bZoom(false), m_colorLine(0x00ff00),
+    m_bPixelPos(false),	m_bMeasureDistance(false), m_nClicked(0), m_hLineLen(0), m_vLineLen(0),
+	m_nMeasureMode(0), m_bMeasureDragging(false)
 {
 	m_pHLineInd = new int[10];
     m_pVLineInd = new int[10];
 	memset(m_pixelPos, 0, sizeof(int) * 2);
+	memset(m_measurePoints, 0, sizeof(int) * 4);
 }
 
 QRenderImage::~QRenderImage()
@@ -253,8 +352,8 @@ void QRenderImage::paintEvent(QPaintEvent *)
 	// Draw assitive lines
 	for (int i = 0; i < m_hLineLen; i++)
 	{
-		QPointF p1; p1.setX(0.0);       p1.setY((double)(m_pHLineInd[i] * h) / (double)m_pImage->height());
-		QPointF p2; p2.setX((double)w); p2.setY((double)(m_pHLineInd[i] * h) / (double)m_pImage->height());
+		QPointF p1; p1.setX(0.0);       p1.setY((double)((m_pHLineInd[i] - m_roi.y()) * h) / (double)m_roi.height());
+		QPointF p2; p2.setX((double)w); p2.setY((double)((m_pHLineInd[i] - m_roi.y()) * h) / (double)m_roi.height());
 
 		painter.setPen(m_colorLine);
 		painter.drawLine(p1, p2);
@@ -262,8 +361,8 @@ void QRenderImage::paintEvent(QPaintEvent *)
 
     for (int i = 0; i < m_vLineLen; i++)
     {
-        QPointF p1; p1.setY(0.0);       p1.setX((double)(m_pVLineInd[i] * w) / (double)m_pImage->width());
-        QPointF p2; p2.setY((double)h); p2.setX((double)(m_pVLineInd[i] * w) / (double)m_pImage->width());
+        QPointF p1; p1.setY(0.0);       p1.setX((double)((m_pVLineInd[i] - m_roi.x()) * w) / (double)m_roi.width());
+        QPointF p2; p2.setY((double)h); p2.setX((double)((m_pVLineInd[i] - m_roi.x()) * w) / (double)m_roi.width());
 
         painter.setPen(m_colorLine);
         painter.drawLine(p1, p2);
@@ -275,15 +374,29 @@ void QRenderImage::paintEvent(QPaintEvent *)
 		painter.setPen(pen);
 
 		QPointF p1, p2;
-		p1.setX(0.0); p1.setY((double)(m_pixelPos[1] * h) / (double)m_pImage->height());
-		p2.setX((double)w); p2.setY((double)(m_pixelPos[1] * h) / (double)m_pImage->height());
+		p1.setX(0.0); p1.setY((double)((m_pixelPos[1] - m_roi.y()) * h) / (double)m_roi.height());
+		p2.setX((double)w); p2.setY((double)((m_pixelPos[1] - m_roi.y()) * h) / (double)m_roi.height());
 		painter.drawLine(p1, p2);
 
-		p1.setY(0.0); p1.setX((double)(m_pixelPos[0] * w) / (double)m_pImage->width());
-		p2.setY((double)h); p2.setX((double)(m_pixelPos[0] * w) / (double)m_pImage->width());
+		p1.setY(0.0); p1.setX((double)((m_pixelPos[0] - m_roi.x()) * w) / (double)m_roi.width());
+		p2.setY((double)h); p2.setX((double)((m_pixelPos[0] - m_roi.x()) * w) / (double)m_roi.width());
 		painter.drawLine(p1, p2);
 	}
 
+	// Measurement region
+	if (m_nMeasureMode)
+	{
+		QPen pen; pen.setColor(Qt::yellow); pen.setWidth(1);
+		painter.setPen(pen);
+
+		QPointF p0((double)((m_measurePoints[0] - m_roi.x()) * w) / (double)m_roi.width(), (double)((m_measurePoints[1] - m_roi.y()) * h) / (double)m_roi.height());
+		QPointF p1((double)((m_measurePoints[2] - m_roi.x()) * w) / (double)m_roi.width(), (double)((m_measurePoints[3] - m_roi.y()) * h) / (double)m_roi.height());
+		if (m_nMeasureMode == 1)
+			painter.drawRect(QRectF(p0, p1).normalized());
+		else
+			painter.drawLine(p0, p1);
+	}
+
 	// Measure distance
 	if (m_bMeasureDistance)
 	{
@@ -305,7 +418,7 @@ void QRenderImage::paintEvent(QPaintEvent *)
 				
 				// Euclidean distance
 				double dist = sqrt((p[0].x() - p[1].x()) * (p[0].x() - p[1].x())
-					+ (p[0].y() - p[1].y()) * (p[0].y() - p[1].y())) * (double)m_pImage->height() / (double)this->height();
+					+ (p[0].y() - p[1].y()) * (p[0].y() - p[1].y())) * (double)m_roi.height() / (double)this->height();
 				printf("Measured distance: %.1f\n", dist);
 
 				QFont font; font.setBold(true);
@@ -320,10 +433,20 @@ void QRenderImage::mousePressEvent(QMouseEvent *e)
 {		
 	QPoint p = e->pos();
 
+	// Measurement region: dragged with the left button
+	if (m_nMeasureMode && (e->button() == Qt::LeftButton))
+	{
+		m_measurePoints[0] = m_measurePoints[2] = m_roi.x() + (int)((double)(p.x() * m_roi.width()) / (double)this->width());
+		m_measurePoints[1] = m_measurePoints[3] = m_roi.y() + (int)((double)(p.y() * m_roi.height()) / (double)this->height());
+		m_bMeasureDragging = true;
+		update();
+		return;
+	}
+
 	if (QRect(0, 0, this->width(), this->height()).contains(p))
 	{
-		m_pixelPos[0] = m_bPixelPos ? (int)((double)(p.x() * m_pImage->width()) / (double)this->width()) : 0;
-		m_pixelPos[1] = m_bPixelPos ? (int)((double)(p.y() * m_pImage->height()) / (double)this->height()) : 0;
+		m_pixelPos[0] = m_bPixelPos ? m_roi.x() + (int)((double)(p.x() * m_roi.width()) / (double)this->width()) : 0;
+		m_pixelPos[1] = m_bPixelPos ? m_roi.y() + (int)((double)(p.y() * m_roi.height()) / (double)this->height()) : 0;
 
 		if (m_bPixelPos)
 		{
@@ -342,16 +465,54 @@ void QRenderImage::mouseMoveEvent(QMouseEvent *e)
 {
 	QPoint p = e->pos();
 
+	if (m_bMeasureDragging)
+	{
+		m_measurePoints[2] = m_roi.x() + (int)((double)(qBound(0, p.x(), this->width() - 1) * m_roi.width()) / (double)this->width());
+		m_measurePoints[3] = m_roi.y() + (int)((double)(qBound(0, p.y(), this->height() - 1) * m_roi.height()) / (double)this->height());
+		update();
+		DidChangedMeasure();
+	}
+
 	if (QRect(0, 0, this->width(), this->height()).contains(p))
 	{
 		QPoint p1;
-		p1.setX((int)((double)(p.x() * m_pImage->width()) / (double)this->width()));
-		p1.setY((int)((double)(p.y() * m_pImage->height()) / (double)this->height()));
+		p1.setX(m_roi.x() + (int)((double)(p.x() * m_roi.width()) / (double)this->width()));
+		p1.setY(m_roi.y() + (int)((double)(p.y() * m_roi.height()) / (double)this->height()));
 
 		DidMovedMouse(p1);
 	}
 }
 
+void QRenderImage::mouseReleaseEvent(QMouseEvent *)
+{
+	if (m_bMeasureDragging)
+	{
+		m_bMeasureDragging = false;
+		DidChangedMeasure();
+	}
+}
+
+void QRenderImage::wheelEvent(QWheelEvent *e)
+{
+	if (!m_bZoom || m_roi.isEmpty())
+		return;
+
+	// Zoom about the image point under the cursor
+	double fx = (double)e->pos().x() / (double)this->width();
+	double fy = (double)e->pos().y() / (double)this->height();
+	double px = m_roi.x() + fx * m_roi.width();
+	double py = m_roi.y() + fy * m_roi.height();
+
+	double s = (e->angleDelta().y() > 0) ? 0.8 : 1.25;
+	int w = qBound(16, (int)(m_zoomRoi.width() * s), m_imageSize.width());
+	int h = qBound(16, (int)(m_zoomRoi.height() * s), m_imageSize.height());
+	int x = qBound(0, (int)(px - fx * w), m_imageSize.width() - w);
+	int y = qBound(0, (int)(py - fy * h), m_imageSize.height() - h);
+
+	m_zoomRoi = QRect(x, y, w, h);
+	DidChangedRoi();
+}
+
 //#ifdef OCT_FLIM
 //if (m_pIntensity && m_pLifetime)
 //{
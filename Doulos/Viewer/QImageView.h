@@ -11,12 +11,15 @@
 
 #include <Common/array.h>
 #include <Common/callback.h>
+#include <Common/ColorLut.h>
 using ColorTableVector = QVector<QVector<QRgb>>;
 
 class ColorTable
 {
 public:
-	explicit ColorTable();
+	explicit ColorTable(); // shares the tables loaded once
+
+	static const ColorLut& lut(int ctable); // aligned 8-bit & 12-bit LUTs (shared)
 
 public:
 	enum colortable { gray = 0, inv_gray, sepia, jet, parula, hot, fire, hsv, 
@@ -40,6 +43,10 @@ public:
 
 public:
 	inline QRenderImage* getRender() { return m_pRenderImage; }
+	uint8_t* getRenderBuffer(); // back buffer at on-screen resolution (drawn without copy)
+	inline const QRect& getRenderRoi() const { return m_imageRoi[m_nBackBuffer]; } // image region of the back buffer
+	inline QSize getRenderSize() const { return m_image[m_nBackBuffer].size(); }
+	inline int getDecimation() const { return m_nDecimation; }
 
 protected:
     void resizeEvent(QResizeEvent *);
@@ -48,6 +55,7 @@ public:
 	void resetSize(int width, int height, bool is_rgb = false);
     void resetColormap(ColorTable::colortable ctable);
 	void setSquare(bool square) { m_bSquareConstraint = square; }
+	void setZoomEnable(bool zoom);
 #ifdef OCT_FLIM
     void setRgbEnable(bool rgb) { m_bRgbUsed = rgb; }
 #endif
@@ -63,17 +71,29 @@ public:
 	void setHorizontalLine(int len, ...);
     void setVerticalLine(int len, ...);
 	void setHLineChangeCallback(const std::function<void(int)> &slot);
+	void setRoiChangedCallback(const std::function<void(void)> &slot);
+	void setMeasureChangedCallback(const std::function<void(void)> &slot);
 
 public slots:
 	void drawImage(uint8_t* pImage);
 	void drawRgbImage(uint8_t* pImage);
 
+private:
+	void createImages(const QVector<QRgb>& colortable);
+	void swapImages(uint8_t* pImage);
+
 private:
     QHBoxLayout *m_pHBoxLayout;
 
 	ColorTable m_colorTable;
     QRenderImage *m_pRenderImage;
 
+	// Pre-allocated front/back images (swapped on each draw) & the image region they cover
+	QImage m_image[2];
+	QRect m_imageRoi[2];
+	int m_nBackBuffer;
+	int m_nDecimation;
+
 private:
     int m_width;
     int m_height;
@@ -99,9 +119,16 @@ protected:
 	void mousePressEvent(QMouseEvent *);
 	void mouseDoubleClickEvent(QMouseEvent *);
 	void mouseMoveEvent(QMouseEvent *);
+	void wheelEvent(QWheelEvent *);
+	void mouseReleaseEvent(QMouseEvent *);
 
 public:
     QImage *m_pImage;
+	QRect m_roi; // image region covered by m_pImage
+
+	bool m_bZoom;
+	QSize m_imageSize;
+	QRect m_zoomRoi; // image region to be rendered (zoom)
 
 	int *m_pHLineInd;
 	int m_hLineLen;
@@ -117,11 +144,18 @@ public:
 	int m_nClicked;
 	int m_point[2][2];
 
+	// Measurement region drawn by dragging (rect or line, image coordinates)
+	int m_nMeasureMode;
+	int m_measurePoints[4];
+	bool m_bMeasureDragging;
+
 	callback2<int, int> DidClickedMouse;
 	callback<void> DidDoubleClickedMouse;
 	callback<QPoint&> DidMovedMouse;
 	callback<int> DidChangedHLine;
     callback<int> DidChangedVLine;
+	callback<void> DidChangedRoi;
+	callback<void> DidChangedMeasure;
 };
 
 
@@ -1,5 +1,6 @@
 
 #include "QScope.h"
+#include <ipps.h>
 
 QScope::QScope(QWidget *parent) :
 	QDialog(parent)
@@ -38,8 +39,6 @@ QScope::QScope(QRange x_range, QRange y_range,
 
 QScope::~QScope()
 {
-	if (m_pRenderArea->m_pData)
-		delete[] m_pRenderArea->m_pData;
 }
 
 
@@ -179,27 +178,50 @@ void QScope::setDcLine(float dcLine)
     m_pRenderArea->m_dcLine = dcLine;
 }
 
-void QScope::drawData(float* pData)
+void QScope::setTraces(int n)
 {
-	if (m_pRenderArea->m_pData != nullptr)
-		memcpy(m_pRenderArea->m_pData, pData, sizeof(float) * (int)m_pRenderArea->m_sizeGraph.width());
+	m_pRenderArea->m_nTraces = n;
+	m_pRenderArea->m_traceMin.resize(n);
+	m_pRenderArea->m_traceMax.resize(n);
+	m_pRenderArea->m_bDecimated.resize(n);
+	m_pRenderArea->m_colorTraces.resize(n);
+	for (int i = 1; i < n; i++)
+		if (!m_pRenderArea->m_colorTraces[i].isValid())
+			m_pRenderArea->m_colorTraces[i] = QColor(0x8c8a6a);
 
 	m_pRenderArea->update();
 }
 
+void QScope::setTraceColor(int trace, QColor color)
+{
+	if (trace < m_pRenderArea->m_nTraces)
+		m_pRenderArea->m_colorTraces[trace] = color;
+}
+
+void QScope::drawData(float* pData)
+{
+	drawData(0, pData, (int)m_pRenderArea->m_sizeGraph.width());
+}
+
 /* FLIM Calib Purpose */
 void QScope::drawData(float* pData, float* pMask)
 {
-	if (m_pRenderArea->m_pData != nullptr)
-		memcpy(m_pRenderArea->m_pData, pData, sizeof(float) * (int)m_pRenderArea->m_sizeGraph.width());
-	
+	(void)pMask;
+	drawData(0, pData, (int)m_pRenderArea->m_sizeGraph.width());
+}
+
+void QScope::drawData(int trace, const float* pData, int length)
+{
+	if ((trace < m_pRenderArea->m_nTraces) && (pData != nullptr))
+		m_pRenderArea->decimate(trace, pData, length);
+
 	m_pRenderArea->update();
 }
 
 
 
 QRenderArea::QRenderArea(QWidget *parent) :
-    QWidget(parent), m_pData(nullptr),
+    QWidget(parent), m_nTraces(1),
     m_winLineLen(0), m_mdLineLen(0), m_dcLine(0),
 	m_nHMajorGrid(8), m_nHMinorGrid(64), m_nVMajorGrid(4), m_bZeroLine(false)
 {
@@ -210,6 +232,11 @@ QRenderArea::QRenderArea(QWidget *parent) :
 
 	m_pWinLineInd = new int[10];
 	m_pMdLineInd = new float[10];
+
+	m_traceMin.resize(1);
+	m_traceMax.resize(1);
+	m_bDecimated.resize(1);
+	m_colorTraces.push_back(QColor(0xfff65d)); // data graph (yellow)
 }
 
 QRenderArea::~QRenderArea()
@@ -227,14 +254,33 @@ void QRenderArea::setSize(QRange xRange, QRange yRange)
 	// Set graph size
 	m_sizeGraph = { m_xRange.max - m_xRange.min , m_yRange.max - m_yRange.min };
 
-	// Allocate data buffer
-	if (m_pData) { delete[] m_pData; m_pData = nullptr; }
-	m_pData = new float[(int)m_sizeGraph.width()];
-	memset(m_pData, 0, sizeof(float) * (int)m_sizeGraph.width());
-	
 	this->update();
 }
 
+void QRenderArea::decimate(int trace, const float* pData, int length)
+{
+	// Per-pixel-column min/max (the painted size does not depend on the trace length)
+	int cols = qMin(length, qMax(this->width(), 1));
+	QVector<float>& _min = m_traceMin[trace];
+	QVector<float>& _max = m_traceMax[trace];
+	_min.resize(cols);
+	_max.resize(cols);
+
+	m_bDecimated[trace] = (cols < length);
+	if (cols == length)
+	{
+		memcpy(_max.data(), pData, sizeof(float) * cols); // drawn as is
+		return;
+	}
+
+	for (int i = 0; i < cols; i++)
+	{
+		int start = (int)((qint64)i * length / cols);
+		int end = (int)((qint64)(i + 1) * length / cols);
+		ippsMinMax_32f(pData + start, end - start, &_min[i], &_max[i]);
+	}
+}
+
 void QRenderArea::setGrid(int nHMajorGrid, int nHMinorGrid, int nVMajorGrid, bool zeroLine)
 {
 	m_nHMajorGrid = nHMajorGrid;
@@ -278,21 +324,29 @@ void QRenderArea::paintEvent(QPaintEvent *)
         painter.drawLine(x0, x1);
     }
 
-    // Draw graph
-    if (m_pData != nullptr)
-    {        
-		painter.setPen(QColor(0xfff65d)); // data graph (yellow)
-		for (int i = (int)(m_xRange.min); i < (int)(m_xRange.max - 1); i++)
-		{			
-			QPointF x0, x1;						
-			x0.setX((float)(i) / (float)m_sizeGraph.width() * w);
-            x0.setY((float)(m_yRange.max - m_pData[i    ]) * (float)h / (float)(m_yRange.max - m_yRange.min));
-            x1.setX((float)(i + 1) / (float)m_sizeGraph.width() * w);
-            x1.setY((float)(m_yRange.max - m_pData[i + 1]) * (float)h / (float)(m_yRange.max - m_yRange.min));			
-
-			painter.drawLine(x0, x1);			
-        }
-    }
+    // Draw graph (one polyline vertex per sample, or a min/max pair per pixel column)
+	float yscale = (float)h / (float)(m_yRange.max - m_yRange.min);
+	for (int t = m_nTraces - 1; t >= 0; t--) // first trace on top
+	{
+		const QVector<float>& _min = m_traceMin[t];
+		const QVector<float>& _max = m_traceMax[t];
+		int cols = _min.size();
+		if (cols < 2) continue;
+
+		bool envelope = m_bDecimated[t];
+		QPolygonF poly;
+		poly.reserve(envelope ? 2 * cols : cols);
+		for (int i = 0; i < cols; i++)
+		{
+			float x = (float)i / (float)cols * w;
+			poly.append(QPointF(x, (float)(m_yRange.max - _max[i]) * yscale));
+			if (envelope)
+				poly.append(QPointF(x, (float)(m_yRange.max - _min[i]) * yscale));
+		}
+
+		painter.setPen(m_colorTraces[t]);
+		painter.drawPolyline(poly);
+	}
 	
     // Draw vertical assistive lines
 	for (int i = 0; i < m_mdLineLen; i++)
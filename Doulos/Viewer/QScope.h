@@ -48,9 +48,13 @@ public:
 	void setMeanDelayLine(int len, ...);
     void setDcLine(float dcLine);
 
+	void setTraces(int n);
+	void setTraceColor(int trace, QColor color);
+
 public slots:
     void drawData(float* pData);
 	void drawData(float* pData, float* pMask);
+	void drawData(int trace, const float* pData, int length);
 
 private:
     QGridLayout *m_pGridLayout;
@@ -76,8 +80,15 @@ public:
 	void setSize(QRange xRange, QRange yRange);
 	void setGrid(int nHMajorGrid, int nHMinorGrid, int nVMajorGrid, bool zeroLine = false);
 
+	void decimate(int trace, const float* pData, int length);
+
 public:
-    float* m_pData;
+	// Traces reduced to per-pixel-column min/max envelopes (as many columns as samples for short traces)
+	int m_nTraces;
+	QVector<QVector<float>> m_traceMin;
+	QVector<QVector<float>> m_traceMax;
+	QVector<bool> m_bDecimated;
+	QVector<QColor> m_colorTraces;
 
     QRange m_xRange;
     QRange m_yRange;
@@ -0,0 +1,217 @@
+
+#include "QTileView.h"
+
+#include <cmath>
+
+
+QTileView::QTileView(QWidget *parent) :
+	QDialog(parent)
+{
+}
+
+QTileView::QTileView(const QString& path, int cache_size, QWidget *parent) :
+	QDialog(parent), m_path(path)
+{
+	// Set default size & frame
+	resize(800, 800);
+	setWindowFlags(Qt::Tool);
+	setWindowTitle("Mosaic - " + QDir(path).dirName());
+
+	// Create widgets
+	m_pRenderTile = new QRenderTile(this);
+	m_pRenderTile->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+
+	m_pLabel_Status = new QLabel(this);
+	m_pRenderTile->DidChangeView = [&](const QString& status) { m_pLabel_Status->setText(status); };
+
+	if (!m_pRenderTile->open(path, cache_size))
+		m_pLabel_Status->setText("Invalid tile pyramid: " + path);
+
+	// Set layout
+	m_pVBoxLayout = new QVBoxLayout;
+	m_pVBoxLayout->setSpacing(2);
+	m_pVBoxLayout->addWidget(m_pRenderTile);
+	m_pVBoxLayout->addWidget(m_pLabel_Status);
+
+	setLayout(m_pVBoxLayout);
+}
+
+QTileView::~QTileView()
+{
+}
+
+void QTileView::keyPressEvent(QKeyEvent *e)
+{
+	if (e->key() != Qt::Key_Escape)
+		QDialog::keyPressEvent(e);
+}
+
+
+void QTileView::invalidate(int x, int y)
+{
+	// The image and its parents at every level
+	for (int k = 0; k < m_pRenderTile->m_levels; k++)
+		m_pRenderTile->remove(k, x >> k, y >> k);
+	m_pRenderTile->update();
+}
+
+
+
+QRenderTile::QRenderTile(QWidget *parent) :
+	QWidget(parent), m_nx(0), m_ny(0), m_width(0), m_height(0), m_levels(0),
+	m_scale(1.0), m_bFitted(false)
+{
+}
+
+QRenderTile::~QRenderTile()
+{
+}
+
+bool QRenderTile::open(const QString& path, int cache_size)
+{
+	QSettings settings(path + "/pyramid.ini", QSettings::IniFormat);
+	settings.beginGroup("pyramid");
+	m_nx = settings.value("nx").toInt();
+	m_ny = settings.value("ny").toInt();
+	m_width = settings.value("width").toInt();
+	m_height = settings.value("height").toInt();
+	m_levels = settings.value("levels").toInt();
+	settings.endGroup();
+
+	m_path = path;
+	m_cache.clear();
+	m_cache.setMaxCost(1024 * cache_size);
+	m_missing.clear();
+
+	return (m_nx > 0) && (m_ny > 0) && (m_width > 0) && (m_height > 0) && (m_levels > 0);
+}
+
+void QRenderTile::fit()
+{
+	if ((m_nx == 0) || (width() == 0))
+		return;
+
+	// Whole mosaic, centered
+	double w = (double)(m_nx * m_width), h = (double)(m_ny * m_height);
+	m_scale = qMin((double)width() / w, (double)height() / h);
+	m_origin = QPointF((w - width() / m_scale) / 2, (h - height() / m_scale) / 2);
+	m_bFitted = true;
+
+	update();
+}
+
+void QRenderTile::remove(int level, int x, int y)
+{
+	QString key = TilePyramid::tileName(m_path, level, x, y);
+	m_cache.remove(key);
+	m_missing.remove(key);
+}
+
+QImage* QRenderTile::tile(int level, int x, int y)
+{
+	QString key = TilePyramid::tileName(m_path, level, x, y);
+
+	QImage* img = m_cache.object(key); // most recently used
+	if (img || m_missing.contains(key))
+		return img;
+
+	// Decode on demand (cost: KB)
+	img = new QImage;
+	if (!img->load(key, "bmp"))
+	{
+		delete img;
+		m_missing.insert(key);
+		return nullptr;
+	}
+
+	int cost = qMax(img->byteCount() / 1024, 1);
+	if (!m_cache.insert(key, img, cost)) // larger than the cache (deleted)
+		return nullptr;
+
+	return img;
+}
+
+
+void QRenderTile::paintEvent(QPaintEvent *)
+{
+	QPainter painter(this);
+	painter.fillRect(rect(), Qt::black);
+
+	if ((m_nx == 0) || (m_levels == 0))
+		return;
+
+	// Level at which a tile pixel is about a screen pixel
+	int level = (m_scale < 1.0) ? (int)floor(log2(1.0 / m_scale)) : 0;
+	level = qMin(qMax(level, 0), m_levels - 1);
+
+	// Visible tiles of the level
+	double tile_w = (double)(m_width << level), tile_h = (double)(m_height << level);
+	int nx = (m_nx + (1 << level) - 1) >> level, ny = (m_ny + (1 << level) - 1) >> level;
+	int x0 = qMax((int)floor(m_origin.x() / tile_w), 0);
+	int y0 = qMax((int)floor(m_origin.y() / tile_h), 0);
+	int x1 = qMin((int)floor((m_origin.x() + width() / m_scale) / tile_w), nx - 1);
+	int y1 = qMin((int)floor((m_origin.y() + height() / m_scale) / tile_h), ny - 1);
+
+	painter.setRenderHint(QPainter::SmoothPixmapTransform, m_scale < 1.0);
+
+	int drawn = 0;
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			QImage* img = tile(level, x, y);
+			if (!img) continue;
+
+			QRectF target((x * tile_w - m_origin.x()) * m_scale, (y * tile_h - m_origin.y()) * m_scale,
+				tile_w * m_scale, tile_h * m_scale);
+			painter.drawImage(target, *img);
+			drawn++;
+		}
+	}
+
+	if (DidChangeView)
+		DidChangeView(QString("Level %1 / %2   Zoom %3 %   Tiles %4   Cache %5 / %6 MB")
+			.arg(level).arg(m_levels - 1).arg(100.0 * m_scale, 0, 'f', 1).arg(drawn)
+			.arg(m_cache.totalCost() / 1024).arg(m_cache.maxCost() / 1024));
+}
+
+void QRenderTile::resizeEvent(QResizeEvent *)
+{
+	if (!m_bFitted)
+		fit();
+}
+
+void QRenderTile::mousePressEvent(QMouseEvent *e)
+{
+	m_lastPos = e->pos();
+}
+
+void QRenderTile::mouseMoveEvent(QMouseEvent *e)
+{
+	// Pan
+	if (e->buttons() & Qt::LeftButton)
+	{
+		QPoint d = e->pos() - m_lastPos;
+		m_origin -= QPointF(d) / m_scale;
+		m_lastPos = e->pos();
+		update();
+	}
+}
+
+void QRenderTile::mouseDoubleClickEvent(QMouseEvent *)
+{
+	fit();
+}
+
+void QRenderTile::wheelEvent(QWheelEvent *e)
+{
+	// Zoom around the cursor (up to 8x the full resolution)
+	double factor = pow(1.25, e->angleDelta().y() / 120.0);
+	double scale = qMin(qMax(m_scale * factor, 1.0 / (double)(1 << m_levels)), 8.0);
+
+	QPointF pos = QPointF(e->pos());
+	m_origin += pos / m_scale - pos / scale;
+	m_scale = scale;
+
+	update();
+}
@@ -0,0 +1,84 @@
+#ifndef QTILEVIEW_H
+#define QTILEVIEW_H
+
+#include <QDialog>
+#include <QtCore>
+#include <QtWidgets>
+
+#include <Common/TilePyramid.h>
+
+class QRenderTile;
+
+
+// Pan & zoom viewer of a tile pyramid (stitched mosaic)
+// Only the tiles visible at the level matching the zoom are decoded, kept in a bounded LRU cache.
+class QTileView : public QDialog
+{
+	Q_OBJECT
+
+private:
+	explicit QTileView(QWidget *parent = 0); // Disabling default constructor
+
+public:
+	explicit QTileView(const QString& path, int cache_size /* MB */, QWidget *parent = 0);
+	virtual ~QTileView();
+
+private:
+	void keyPressEvent(QKeyEvent *e);
+
+public:
+	inline QRenderTile* getRender() { return m_pRenderTile; }
+	inline const QString& getPath() const { return m_path; }
+
+public slots:
+	void invalidate(int x, int y); // tiles updated by the image at grid (x, y)
+
+private:
+	QString m_path;
+
+	QVBoxLayout *m_pVBoxLayout;
+	QRenderTile *m_pRenderTile;
+	QLabel *m_pLabel_Status;
+};
+
+
+class QRenderTile : public QWidget
+{
+	Q_OBJECT
+
+public:
+	explicit QRenderTile(QWidget *parent = 0);
+	virtual ~QRenderTile();
+
+public:
+	bool open(const QString& path, int cache_size);
+	void fit();
+	void remove(int level, int x, int y);
+
+protected:
+	void paintEvent(QPaintEvent *);
+	void resizeEvent(QResizeEvent *);
+	void mousePressEvent(QMouseEvent *);
+	void mouseMoveEvent(QMouseEvent *);
+	void mouseDoubleClickEvent(QMouseEvent *);
+	void wheelEvent(QWheelEvent *);
+
+private:
+	QImage* tile(int level, int x, int y);
+
+public:
+	QString m_path;
+	int m_nx, m_ny, m_width, m_height, m_levels;
+
+	QCache<QString, QImage> m_cache; // decoded tiles (cost: KB)
+	QSet<QString> m_missing; // tiles not written yet (until invalidated)
+
+	double m_scale; // screen pixels per mosaic pixel
+	QPointF m_origin; // mosaic position at the top-left corner
+	QPoint m_lastPos;
+	bool m_bFitted;
+
+	std::function<void(const QString&)> DidChangeView;
+};
+
+#endif // QTILEVIEW_H
@@ -11,6 +11,7 @@
 
 #include <Common/ImageObject.h>
 #include <Common/medfilt.h>
+#include <Common/TilePyramid.h>
 
 #include <iostream>
 #include <deque>
@@ -347,6 +348,27 @@ void MemoryBuffer::write()
     ImageObject imgObj_Ch3(roi_image.width, roi_image.height, temp_ctable.m_colorTableVector.at(color_table_index[m_pConfig->channelImageMode[2]]));
     ImageObject imgObj_Ch4(roi_image.width, roi_image.height, temp_ctable.m_colorTableVector.at(color_table_index[m_pConfig->channelImageMode[3]]));
 
+    // Tile pyramids of the stitched mosaic (built as the images are written)
+    TilePyramid pyramid[4];
+    bool mosaic = m_nRecordedImages > 1;
+    bool pyramid_ok[4] = { true, true, true, true }; // channels still built
+    if (mosaic)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (!pyramid[i].initialize(path0[i] + "pyramid", m_pConfig->imageStichingXStep, m_pConfig->imageStichingYStep,
+                    roi_image.width, m_pConfig->nLines - GALVO_FLYING_BACK, temp_ctable.m_colorTableVector.at(color_table_index[m_pConfig->channelImageMode[i]])))
+            {
+                SendStatusMessage("Error occurred while creating the mosaic tile pyramid.", true);
+                mosaic = false;
+                break;
+            }
+        }
+    }
+
+    medfilt filt(roi_image.width, roi_image.height, m_pConfig->medianFilterSize);
+    np::FloatArray2 filt_image(roi_image.width, 4 * roi_image.height);
+
     // Writing images
     if (file.open(QIODevice::WriteOnly))
     {
@@ -370,6 +392,14 @@ void MemoryBuffer::write()
             float* scan_ch3 = image + 2 * m_pConfig->imageSize;
             float* scan_ch4 = image + 3 * m_pConfig->imageSize;
 
+            if (filt.getKernel())
+            {
+                filt(scan_ch1, &filt_image(0, 0 * roi_image.height)); scan_ch1 = &filt_image(0, 0 * roi_image.height);
+                filt(scan_ch2, &filt_image(0, 1 * roi_image.height)); scan_ch2 = &filt_image(0, 1 * roi_image.height);
+                filt(scan_ch3, &filt_image(0, 2 * roi_image.height)); scan_ch3 = &filt_image(0, 2 * roi_image.height);
+                filt(scan_ch4, &filt_image(0, 3 * roi_image.height)); scan_ch4 = &filt_image(0, 3 * roi_image.height);
+            }
+
             ippiScale_32f8u_C1R(scan_ch1, sizeof(float) * roi_image.width, imgObj_Ch1.arr.raw_ptr(), sizeof(uint8_t) * roi_image.width,
                 roi_image, m_pConfig->imageContrastRange[0].min, m_pConfig->imageContrastRange[0].max);
             ippiScale_32f8u_C1R(scan_ch2, sizeof(float) * roi_image.width, imgObj_Ch2.arr.raw_ptr(), sizeof(uint8_t) * roi_image.width,
@@ -379,13 +409,6 @@ void MemoryBuffer::write()
             ippiScale_32f8u_C1R(scan_ch4, sizeof(float) * roi_image.width, imgObj_Ch4.arr.raw_ptr(), sizeof(uint8_t) * roi_image.width,
                 roi_image, m_pConfig->imageContrastRange[3].min, m_pConfig->imageContrastRange[3].max);
 
-#ifdef MED_FILT
-            (*m_pOperationTab->getStreamTab()->getVisualizationTab()->getMedfilt())(imgObj_Ch1.arr);
-            (*m_pOperationTab->getStreamTab()->getVisualizationTab()->getMedfilt())(imgObj_Ch2.arr);
-            (*m_pOperationTab->getStreamTab()->getVisualizationTab()->getMedfilt())(imgObj_Ch3.arr);
-            (*m_pOperationTab->getStreamTab()->getVisualizationTab()->getMedfilt())(imgObj_Ch4.arr);
-#endif
-
             int x = i % m_pConfig->imageStichingXStep;
             int y = i / m_pConfig->imageStichingXStep;
             if (y % 2 == 1)
@@ -396,23 +419,45 @@ void MemoryBuffer::write()
             for (int j = 0; j < 4; j++)
                 write_path[j] = (m_nRecordedImages > 1) ? path0[j] : path;
 
-            imgObj_Ch1.qindeximg.copy(0, 0, m_pConfig->nPixels, m_pConfig->nLines - GALVO_FLYING_BACK)
+            imgObj_Ch1.topRows(m_pConfig->nLines - GALVO_FLYING_BACK)
                 .save(write_path[0] + QString("%1_image_acc_%2_avg_%3_[%4 %5]_%6.bmp").arg(mode_name[m_pConfig->channelImageMode[0]])
                     .arg(m_pConfig->imageAccumulationFrames).arg(m_pConfig->imageAveragingFrames)
                     .arg(m_pConfig->imageContrastRange[0].min, 2, 'f', 1).arg(m_pConfig->imageContrastRange[0].max, 2, 'f', 1).arg(ii + 1, 3, 10, (QChar)'0'), "bmp");
-            imgObj_Ch2.qindeximg.copy(0, 0, m_pConfig->nPixels, m_pConfig->nLines - GALVO_FLYING_BACK)
+            imgObj_Ch2.topRows(m_pConfig->nLines - GALVO_FLYING_BACK)
                 .save(write_path[1] + QString("%1_image_acc_%2_avg_%3_[%4 %5]_%6.bmp").arg(mode_name[m_pConfig->channelImageMode[1]])
                     .arg(m_pConfig->imageAccumulationFrames).arg(m_pConfig->imageAveragingFrames)
                     .arg(m_pConfig->imageContrastRange[1].min, 2, 'f', 1).arg(m_pConfig->imageContrastRange[1].max, 2, 'f', 1).arg(ii + 1, 3, 10, (QChar)'0'), "bmp");
-            imgObj_Ch3.qindeximg.copy(0, 0, m_pConfig->nPixels, m_pConfig->nLines - GALVO_FLYING_BACK)
+            imgObj_Ch3.topRows(m_pConfig->nLines - GALVO_FLYING_BACK)
                 .save(write_path[2] + QString("%1_image_acc_%2_avg_%3_[%4 %5]_%6.bmp").arg(mode_name[m_pConfig->channelImageMode[2]])
                     .arg(m_pConfig->imageAccumulationFrames).arg(m_pConfig->imageAveragingFrames)
                     .arg(m_pConfig->imageContrastRange[2].min, 2, 'f', 1).arg(m_pConfig->imageContrastRange[2].max, 2, 'f', 1).arg(ii + 1, 3, 10, (QChar)'0'), "bmp");
-            imgObj_Ch4.qindeximg.copy(0, 0, m_pConfig->nPixels, m_pConfig->nLines - GALVO_FLYING_BACK)
+            imgObj_Ch4.topRows(m_pConfig->nLines - GALVO_FLYING_BACK)
                 .save(write_path[3] + QString("%1_image_acc_%2_avg_%3_[%4 %5]_%6.bmp").arg(mode_name[m_pConfig->channelImageMode[3]])
                     .arg(m_pConfig->imageAccumulationFrames).arg(m_pConfig->imageAveragingFrames)
                     .arg(m_pConfig->imageContrastRange[3].min, 2, 'f', 1).arg(m_pConfig->imageContrastRange[3].max, 2, 'f', 1).arg(ii + 1, 3, 10, (QChar)'0'), "bmp");
 
+            if (mosaic)
+            {
+                ImageObject* imgObj[4] = { &imgObj_Ch1, &imgObj_Ch2, &imgObj_Ch3, &imgObj_Ch4 };
+                bool written = false;
+                for (int j = 0; j < 4; j++)
+                {
+                    if (!pyramid_ok[j]) continue;
+                    if (!pyramid[j].add(x, y, imgObj[j]->arr.raw_ptr(), roi_image.width))
+                    {
+                        // Stop building the pyramid of this channel
+                        char msg[256];
+                        sprintf(msg, "Error occurred while writing the mosaic tile pyramid (%s).", mode_name[m_pConfig->channelImageMode[j]]);
+                        SendStatusMessage(msg, true);
+                        pyramid_ok[j] = false;
+                        continue;
+                    }
+                    written = true;
+                }
+                if (written)
+                    emit wroteMosaicTile(x, y);
+            }
+
             // Push back to the original queue
             emit wroteSingleFrame(i);
 
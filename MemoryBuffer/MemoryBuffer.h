@@ -42,6 +42,7 @@ private: // writing threading operation
 
 signals:
 	void wroteSingleFrame(int);
+	void wroteMosaicTile(int, int);
 	void finishedBufferAllocation();
 	void finishedWritingThread(bool);
 